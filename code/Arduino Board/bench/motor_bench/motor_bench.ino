@@ -0,0 +1,100 @@
+// Cycles for a full direction change of both wheels, MotorController
+// against FastMotorController, counted with Timer 1 at the CPU clock.
+// Runs under simavr or on an Uno; see ../Makefile
+#include <avr/sleep.h>
+#include "FastMotorController.h"
+
+// Same pins as code.ino
+const uint8_t MOTOR1_IN1 = 3;
+const uint8_t MOTOR1_IN2 = 4;
+const uint8_t MOTOR2_IN1 = 5;
+const uint8_t MOTOR2_IN2 = 6;
+const uint8_t MOTOR1_ENA = 9;
+const uint8_t MOTOR2_ENB = 10;
+
+const int RUNS = 16;
+
+// Opens up the per-wheel writes, the part a direction change costs
+class RuntimeBench : public MotorController {
+  public:
+    RuntimeBench() : MotorController(MOTOR1_IN1, MOTOR1_IN2, MOTOR2_IN1, MOTOR2_IN2, MOTOR1_ENA, MOTOR2_ENB) {}
+    using MotorController::writeLeft;
+    using MotorController::writeRight;
+};
+
+class FastBench : public FastMotorController<MOTOR1_IN1, MOTOR1_IN2, MOTOR2_IN1, MOTOR2_IN2, MOTOR1_ENA, MOTOR2_ENB> {
+  public:
+    using FastMotorController::writeLeft;
+    using FastMotorController::writeRight;
+};
+
+RuntimeBench runtimeMotors;
+FastBench fastMotors;
+int direction = 1;
+
+void empty() {}
+
+// Rotating left to rotating right and back, so every call flips the
+// direction pins of both wheels
+void runtimeChange() {
+    direction = -direction;
+    runtimeMotors.writeLeft(-200 * direction);
+    runtimeMotors.writeRight(200 * direction);
+}
+
+void fastChange() {
+    direction = -direction;
+    fastMotors.writeLeft(-200 * direction);
+    fastMotors.writeRight(200 * direction);
+}
+
+// Fewest cycles over the runs, so a stray interrupt can't inflate it
+uint16_t countCycles(void (*run)()) {
+    uint16_t best = 0xFFFF;
+    for (int i = 0; i < RUNS; i++) {
+        uint8_t oldSREG = SREG;
+        cli();
+        TCNT1 = 0;
+        run();
+        uint16_t cycles = TCNT1;
+        SREG = oldSREG;
+        best = min(best, cycles);
+    }
+    return best;
+}
+
+void report(const char* name, uint16_t cycles) {
+    Serial.print(name);
+    Serial.print(cycles);
+    Serial.print(" cycles, ");
+    Serial.print(cycles / 16.0, 2);
+    Serial.println(" us");
+}
+
+void setup() {
+    Serial.begin(115200);
+    runtimeMotors.begin();
+    fastMotors.begin();
+
+    // Timer 1 free running at 16MHz; the enables on pins 9 and 10 only
+    // see their PWM frequency change
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+
+    uint16_t overhead = countCycles(empty);
+    uint16_t runtime = countCycles(runtimeChange) - overhead;
+    uint16_t fast = countCycles(fastChange) - overhead;
+    report("MotorController:     ", runtime);
+    report("FastMotorController: ", fast);
+    Serial.print("Saved per direction change: ");
+    Serial.print(runtime - fast);
+    Serial.println(" cycles");
+    Serial.flush();
+
+    // simavr quits on sleep with interrupts off
+    cli();
+    sleep_enable();
+    sleep_cpu();
+}
+
+void loop() {}
@@ -0,0 +1,31 @@
+#ifndef CURRENT_MONITOR_H
+#define CURRENT_MONITOR_H
+
+#include <Arduino.h>
+
+// Stall and overcurrent detection on a stream of motor current samples.
+// Knows nothing about the ADC, so recorded traces can be replayed
+// through it sample by sample
+class CurrentMonitor {
+  private:
+    static const int WINDOW_SIZE = 16;
+    uint16_t window[WINDOW_SIZE]; // mA
+    uint8_t head;
+    uint8_t count;
+    uint32_t sum;
+    uint16_t stallLimit;  // mA, windowed average
+    uint8_t stallSamples; // Samples the average must stay over the limit
+    uint16_t peakLimit;   // mA, single samples
+    uint8_t overStall;
+    uint8_t overPeak;
+    const uint8_t PEAK_SAMPLES = 3; // Rides out commutation spikes
+
+  public:
+    CurrentMonitor();
+    void setLimits(uint16_t stallMa, uint8_t samples, uint16_t peakMa);
+    bool addSample(uint16_t mA);
+    void reset();
+    uint16_t getAverage();
+};
+
+#endif
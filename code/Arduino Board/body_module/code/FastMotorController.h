@@ -0,0 +1,74 @@
+#ifndef FAST_MOTOR_CONTROLLER_H
+#define FAST_MOTOR_CONTROLLER_H
+
+#include "MotorController.h"
+
+// MotorController with the pins fixed at compile time. On the ATmega328P
+// each wheel's direction pins are set with one masked port write instead
+// of two digitalWrite() calls; the enable pins keep using analogWrite()
+// so the timers stay set up by the core. Other boards get the plain
+// runtime-pinned behavior.
+template <uint8_t IN1, uint8_t IN2, uint8_t IN3, uint8_t IN4, uint8_t EN_A, uint8_t EN_B>
+class FastMotorController : public MotorController {
+#if defined(__AVR_ATmega328P__)
+  private:
+    static_assert(IN1 < 20 && IN2 < 20 && IN3 < 20 && IN4 < 20, "Direction pins must be Uno digital or analog pins");
+
+    // Uno pin numbering: 0-7 on PORTD, 8-13 on PORTB, A0-A5 (14-19) on PORTC
+    static constexpr char portOf(uint8_t pin) {
+        return pin < 8 ? 'D' : (pin < 14 ? 'B' : 'C');
+    }
+
+    static constexpr uint8_t maskOf(uint8_t pin) {
+        return 1 << (pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14));
+    }
+
+    // Servo and other ISRs write the same ports, so the read-modify-write
+    // runs with interrupts off. The port is a constant, so all but one
+    // branch compile away
+    static inline void writePort(char port, uint8_t clear, uint8_t set) {
+        uint8_t oldSREG = SREG;
+        cli();
+        if (port == 'D') PORTD = (PORTD & ~clear) | set;
+        else if (port == 'B') PORTB = (PORTB & ~clear) | set;
+        else PORTC = (PORTC & ~clear) | set;
+        SREG = oldSREG;
+    }
+
+    template <uint8_t A, uint8_t B>
+    static inline void writePair(bool highA, bool highB) {
+        uint8_t setA = highA ? maskOf(A) : 0;
+        uint8_t setB = highB ? maskOf(B) : 0;
+        if (portOf(A) == portOf(B)) {
+            writePort(portOf(A), maskOf(A) | maskOf(B), setA | setB);
+        }
+        else {
+            writePort(portOf(A), maskOf(A), setA);
+            writePort(portOf(B), maskOf(B), setB);
+        }
+    }
+
+  protected:
+    void writeLeft(int output) override {
+        writePair<IN1, IN2>(output > 0, output < 0);
+        analogWrite(EN_A, abs(output));
+    }
+
+    void writeRight(int output) override {
+        writePair<IN3, IN4>(output > 0, output < 0);
+        analogWrite(EN_B, abs(output));
+    }
+
+    void writeBrake() override {
+        writePair<IN1, IN2>(true, true);
+        writePair<IN3, IN4>(true, true);
+        analogWrite(EN_A, 255);
+        analogWrite(EN_B, 255);
+    }
+#endif
+
+  public:
+    FastMotorController() : MotorController(IN1, IN2, IN3, IN4, EN_A, EN_B) {}
+};
+
+#endif
@@ -1,5 +1,10 @@
 #include "MotorController.h"
 
+volatile uint8_t* MotorController::encoderInput[2] = {nullptr, nullptr};
+uint8_t MotorController::encoderMask[2] = {0, 0};
+volatile uint8_t MotorController::encoderLevel[2] = {0, 0};
+volatile uint16_t MotorController::encoderTicks[2] = {0, 0};
+
 MotorController::MotorController(uint8_t in1, uint8_t in2, uint8_t in3, uint8_t in4, uint8_t enA, uint8_t enB) {
     in1Pin = in1;
     in2Pin = in2;
@@ -8,6 +13,58 @@ MotorController::MotorController(uint8_t in1, uint8_t in2, uint8_t in3, uint8_t
     enAPin = enA;
     enBPin = enB;
     currentSpeed = 200;
+    speedLimit = 255;
+    leftTarget = 0;
+    rightTarget = 0;
+    leftOutput = 0;
+    rightOutput = 0;
+    accelRate = 600;  // Full speed from standstill in ~0.4s
+    decelRate = 1200; // Braking may be quicker than starting
+    lastRampTime = 0;
+    encodersAttached = false;
+    closedLoop = false;
+    feedForward = 384; // 1.5, ~170 ticks/s at full PWM
+    kp = 512;          // 2.0
+    ki = 1024;         // 4.0
+    lastControlTime = 0;
+    resetSpeedLoop();
+    umPerTick = 5100;     // 65mm wheel, 20 slot disc counted on both edges
+    modelFullSpeed = 300;
+    modelDeadband = 40;
+    lastTravelTime = 0;
+    trackWidth = 130;
+    bound = BOUND_NONE;
+    boundTarget = 0;
+    boundStartTime = 0;
+    boundStartLeft = 0;
+    boundStartRight = 0;
+    motionDone = false;
+    braking = false;
+    brakeStart = 0;
+    brakeTime = 150;
+    batteryAttached = false;
+    batteryPin = 0;
+    batteryFullScale = 0;
+    batteryVoltage = 0;
+    nominalVoltage = 0;
+    batteryScale = 256;
+    lastBatteryTime = 0;
+    currentAttached = false;
+    currentPin = 0;
+    currentFullScale = 0;
+    lastCurrentTime = 0;
+    stallCount = 0;
+    stallBackoff = 300;
+    for (int i = 0; i < 2; i++) {
+        wheelDirection[i] = 1;
+        encoderRead[i] = 0;
+        ticksSinceControl[i] = 0;
+        encoderCount[i] = 0;
+        modelTravel[i] = 0;
+        trim[i].offset = 0;
+        trim[i].gain = 256;
+        trim[i].deadband = 0;
+    }
 }
 
 void MotorController::begin() {
@@ -17,76 +74,671 @@ void MotorController::begin() {
     pinMode(in4Pin, OUTPUT);
     pinMode(enAPin, OUTPUT);
     pinMode(enBPin, OUTPUT);
-    stop();
+    loadCalibration();
+    stop(STOP_COAST);
 }
 
-void MotorController::moveForward() {
+// Steps the outputs toward their targets, call every loop pass
+void MotorController::update() {
+    if (encodersAttached) {
+        readEncoders();
+    }
+    else {
+        integrateModel();
+    }
+    if (bound != BOUND_NONE) {
+        checkBound();
+    }
+    if (braking) {
+        // Nothing else drives the bridge until the brake lets go
+        if (millis() - brakeStart < brakeTime) return;
+        releaseBrake();
+    }
+
+    unsigned long now = millis();
+    if (batteryAttached && now - lastBatteryTime >= BATTERY_INTERVAL) {
+        lastBatteryTime = now;
+        if (readBattery()) refreshOutputs();
+    }
+    if (currentAttached && now - lastCurrentTime >= CURRENT_INTERVAL) {
+        lastCurrentTime = now;
+        uint16_t current = (uint32_t)analogRead(currentPin) * currentFullScale / 1023;
+        if (leftOutput == 0 && rightOutput == 0) {
+            currentMonitor.reset();
+        }
+        else if (currentMonitor.addSample(current)) {
+            // The back-off below has run the rest of this update
+            handleStall();
+            return;
+        }
+    }
+
+    unsigned long ticks = (now - lastRampTime) / RAMP_INTERVAL;
+    lastRampTime += ticks * RAMP_INTERVAL;
+    ticks = min(ticks, MAX_RAMP_TICKS);
+
+    int left = rampToward(leftOutput, leftTarget, ticks);
+    int right = rampToward(rightOutput, rightTarget, ticks);
+    if (closedLoop) {
+        // The ramped outputs are speed setpoints, the loop drives the PWM
+        leftOutput = left;
+        rightOutput = right;
+        updateSpeedLoop();
+        return;
+    }
+    if (left != leftOutput) {
+        leftOutput = left;
+        driveLeft(leftOutput);
+    }
+    if (right != rightOutput) {
+        rightOutput = right;
+        driveRight(rightOutput);
+    }
+}
+
+int MotorController::rampToward(int output, int target, unsigned long ticks) {
+    // Reversing runs down to zero first, so it is braking all the way
+    int next = target;
+    if ((output > 0 && target < 0) || (output < 0 && target > 0)) next = 0;
+
+    unsigned int rate = abs(next) < abs(output) ? decelRate : accelRate;
+    if (rate == 0) {
+        // Without an acceleration limit, carry straight on past zero
+        return (next != target && accelRate == 0) ? target : next;
+    }
+
+    long step = max((long)rate * RAMP_INTERVAL / 1000, 1L) * ticks;
+    return constrain((long)next, output - step, output + step);
+}
+
+void MotorController::writeChannel(uint8_t inA, uint8_t inB, uint8_t en, int output) {
+    digitalWrite(inA, output > 0 ? HIGH : LOW);
+    digitalWrite(inB, output < 0 ? HIGH : LOW);
+    analogWrite(en, abs(output));
+}
+
+void MotorController::writeLeft(int output) {
+    writeChannel(in1Pin, in2Pin, enAPin, output);
+}
+
+void MotorController::writeRight(int output) {
+    writeChannel(in3Pin, in4Pin, enBPin, output);
+}
+
+void MotorController::driveLeft(int output) {
+    writeLeft(calibrate(WHEEL_LEFT, output));
+}
+
+void MotorController::driveRight(int output) {
+    writeRight(calibrate(WHEEL_RIGHT, output));
+}
+
+// Rewrites the outputs after the calibration changed. The speed loop
+// rewrites its own on its next pass
+void MotorController::refreshOutputs() {
+    if (braking || closedLoop) return;
+    driveLeft(leftOutput);
+    driveRight(rightOutput);
+}
+
+// Commanded PWM to bridge PWM: trim, lift past the dead band, then
+// scale up as the battery sags
+int MotorController::calibrate(Wheel wheel, int output) {
+    if (output == 0) return 0;
+    const MotorTrim& t = trim[wheel];
+    long magnitude = (long)abs(output) * t.gain / 256 + t.offset;
+    if (magnitude <= 0) return 0;
+    magnitude = t.deadband + magnitude * (255 - t.deadband) / 255;
+    magnitude = min(magnitude * batteryScale / 256, 255L);
+    return output < 0 ? -magnitude : magnitude;
+}
+
+void MotorController::writeBrake() {
     digitalWrite(in1Pin, HIGH);
-    digitalWrite(in2Pin, LOW);
+    digitalWrite(in2Pin, HIGH);
     digitalWrite(in3Pin, HIGH);
-    digitalWrite(in4Pin, LOW);
-    analogWrite(enAPin, currentSpeed);
-    analogWrite(enBPin, currentSpeed);
+    digitalWrite(in4Pin, HIGH);
+    analogWrite(enAPin, 255);
+    analogWrite(enBPin, 255);
+}
+
+void MotorController::releaseBrake() {
+    braking = false;
+    writeLeft(0);
+    writeRight(0);
+}
+
+// Signed PWM per wheel, positive is forward. A new motion
+// replaces any bounded one still running
+void MotorController::setWheelSpeeds(int left, int right) {
+    bound = BOUND_NONE;
+    motionDone = false;
+    applyWheelSpeeds(left, right);
+}
+
+void MotorController::applyWheelSpeeds(int left, int right) {
+    if (braking) releaseBrake();
+    left = constrain(left, -255, 255);
+    right = constrain(right, -255, 255);
+
+    // The speed limit scales both wheels alike, keeping the curvature
+    int fastest = max(abs(left), abs(right));
+    if (fastest > speedLimit) {
+        left = (long)left * speedLimit / fastest;
+        right = (long)right * speedLimit / fastest;
+    }
+
+    // An idle ramp restarts its clock, so the time spent idle
+    // does not turn into one big step
+    if (!isRamping()) lastRampTime = millis();
+    leftTarget = left;
+    rightTarget = right;
+    update();
+}
+
+// Drives round a circle of radiusMm, measured from the midpoint between
+// the wheels, with the outer wheel at speed. The inner wheel runs at
+// speed * (R - track/2) / (R + track/2), so half the track width pivots
+// on the inner wheel and 0 spins in place. A positive radius bends
+// left; a negative speed drives the same arc in reverse
+void MotorController::arc(int speed, int radiusMm) {
+    long twiceRadius = 2L * abs(radiusMm);
+    long inner = (long)speed * (twiceRadius - trackWidth) / (twiceRadius + trackWidth);
+    if (radiusMm >= 0) {
+        setWheelSpeeds(inner, speed);
+    }
+    else {
+        setWheelSpeeds(speed, inner);
+    }
+}
+
+void MotorController::moveForward() {
+    setWheelSpeeds(currentSpeed, currentSpeed);
 }
 
 void MotorController::moveBackward() {
-    digitalWrite(in1Pin, LOW);
-    digitalWrite(in2Pin, HIGH);
-    digitalWrite(in3Pin, LOW);
-    digitalWrite(in4Pin, HIGH);
-    analogWrite(enAPin, currentSpeed);
-    analogWrite(enBPin, currentSpeed);
+    setWheelSpeeds(-currentSpeed, -currentSpeed);
 }
 
+// A radius of 1.5 track widths, the inner wheel at half speed
 void MotorController::turnLeft() {
-    digitalWrite(in1Pin, HIGH);
-    digitalWrite(in2Pin, LOW);
-    digitalWrite(in3Pin, HIGH);
-    digitalWrite(in4Pin, LOW);
-    analogWrite(enAPin, currentSpeed / 2);
-    analogWrite(enBPin, currentSpeed);
+    arc(currentSpeed, 3 * trackWidth / 2);
 }
 
 void MotorController::turnRight() {
-    digitalWrite(in1Pin, HIGH);
-    digitalWrite(in2Pin, LOW);
-    digitalWrite(in3Pin, HIGH);
-    digitalWrite(in4Pin, LOW);
-    analogWrite(enAPin, currentSpeed);
-    analogWrite(enBPin, currentSpeed / 2);
+    arc(currentSpeed, -3 * trackWidth / 2);
 }
 
 void MotorController::rotateLeft() {
-    digitalWrite(in1Pin, LOW);
-    digitalWrite(in2Pin, HIGH);
-    digitalWrite(in3Pin, HIGH);
-    digitalWrite(in4Pin, LOW);
-    analogWrite(enAPin, currentSpeed);
-    analogWrite(enBPin, currentSpeed);
+    setWheelSpeeds(-currentSpeed, currentSpeed);
 }
 
 void MotorController::rotateRight() {
-    digitalWrite(in1Pin, HIGH);
-    digitalWrite(in2Pin, LOW);
-    digitalWrite(in3Pin, LOW);
-    digitalWrite(in4Pin, HIGH);
-    analogWrite(enAPin, currentSpeed);
-    analogWrite(enBPin, currentSpeed);
+    setWheelSpeeds(currentSpeed, -currentSpeed);
+}
+
+void MotorController::stop(StopMode mode) {
+    if (mode == STOP_RAMP) {
+        setWheelSpeeds(0, 0);
+        return;
+    }
+
+    // Coasting and braking both bypass the ramp
+    bound = BOUND_NONE;
+    leftTarget = 0;
+    rightTarget = 0;
+    leftOutput = 0;
+    rightOutput = 0;
+    resetSpeedLoop();
+    if (mode == STOP_BRAKE && brakeTime > 0) {
+        braking = true;
+        brakeStart = millis();
+        writeBrake();
+    }
+    else {
+        releaseBrake();
+    }
+}
+
+// Stops as short as the bridge allows
+void MotorController::emergencyStop() {
+    stop(STOP_BRAKE);
+}
+
+void MotorController::setBrakeTime(unsigned int ms) {
+    brakeTime = ms;
 }
 
-void MotorController::stop() {
-    digitalWrite(in1Pin, LOW);
-    digitalWrite(in2Pin, LOW);
-    digitalWrite(in3Pin, LOW);
-    digitalWrite(in4Pin, LOW);
-    analogWrite(enAPin, 0);
-    analogWrite(enBPin, 0);
+bool MotorController::isBraking() {
+    return braking;
 }
 
+// PWM, or ticks/s with the speed loop closed
 void MotorController::setSpeed(int speed) {
     currentSpeed = constrain(speed, 0, 255);
 }
 
 int MotorController::getSpeed() {
     return currentSpeed;
+}
+
+// Caps the applied speed without touching the speed set with setSpeed()
+void MotorController::setSpeedLimit(int limit) {
+    speedLimit = constrain(limit, 0, 255);
+}
+
+void MotorController::clearSpeedLimit() {
+    speedLimit = 255;
+}
+
+int MotorController::getSpeedLimit() {
+    return speedLimit;
+}
+
+// Slew limits in PWM counts per second, 0 switches a limit off
+void MotorController::setRamp(unsigned int accel, unsigned int decel) {
+    accelRate = accel;
+    decelRate = decel;
+}
+
+bool MotorController::isRamping() {
+    return leftOutput != leftTarget || rightOutput != rightTarget;
+}
+
+int MotorController::getLeftOutput() {
+    return leftOutput;
+}
+
+int MotorController::getRightOutput() {
+    return rightOutput;
+}
+
+// Single-channel encoders, e.g. slotted discs; every edge is a tick.
+// Pins without an external interrupt use a pin change interrupt, which
+// the sketch has to claim with PIN_CHANGE_ISR(). Returns false when a
+// pin has neither
+bool MotorController::attachEncoders(uint8_t leftPin, uint8_t rightPin) {
+    uint8_t pins[2] = {leftPin, rightPin};
+    for (int i = 0; i < 2; i++) {
+        pinMode(pins[i], INPUT);
+        encoderInput[i] = portInputRegister(digitalPinToPort(pins[i]));
+        encoderMask[i] = digitalPinToBitMask(pins[i]);
+        encoderLevel[i] = *encoderInput[i] & encoderMask[i];
+        encoderTicks[i] = 0;
+        encoderRead[i] = 0;
+        encoderCount[i] = 0;
+
+        int interruptNum = digitalPinToInterrupt(pins[i]);
+        if (interruptNum != NOT_AN_INTERRUPT) {
+            attachInterrupt(interruptNum, pollEncoders, CHANGE);
+        }
+        else if (!PinChange::attach(pins[i], pollEncoders)) {
+            // Undo the pins already attached rather than report failure
+            // with one encoder still counting
+            for (int j = 0; j < i; j++) {
+                int attached = digitalPinToInterrupt(pins[j]);
+                if (attached != NOT_AN_INTERRUPT) detachInterrupt(attached);
+                else PinChange::detach(pins[j]);
+                encoderInput[j] = nullptr;
+            }
+            encoderInput[i] = nullptr;
+            return false;
+        }
+    }
+    encodersAttached = true;
+    return true;
+}
+
+// Counts an edge on whichever encoder pin changed
+void MotorController::pollEncoders() {
+    for (int i = 0; i < 2; i++) {
+        if (encoderInput[i] == nullptr) continue;
+        uint8_t level = *encoderInput[i] & encoderMask[i];
+        if (level != encoderLevel[i]) {
+            encoderLevel[i] = level;
+            encoderTicks[i]++;
+        }
+    }
+}
+
+// With the loop closed, speeds are in encoder ticks per second
+bool MotorController::setClosedLoop(bool enabled) {
+    if (enabled && !encodersAttached) return false;
+    if (enabled != closedLoop) {
+        // The command units change, so start again from standstill
+        stop(STOP_COAST);
+        closedLoop = enabled;
+        lastControlTime = millis();
+    }
+    return true;
+}
+
+bool MotorController::isClosedLoop() {
+    return closedLoop;
+}
+
+void MotorController::setSpeedGains(int feedForwardQ8, int kpQ8, int kiQ8) {
+    feedForward = feedForwardQ8;
+    kp = kpQ8;
+    ki = kiQ8;
+}
+
+void MotorController::resetSpeedLoop() {
+    for (int i = 0; i < 2; i++) {
+        speedLoop[i].measured = 0;
+        speedLoop[i].pwm = 0;
+        speedLoop[i].integral = 0;
+        speedLoop[i].peakError = 0;
+    }
+}
+
+void MotorController::updateSpeedLoop() {
+    unsigned long now = millis();
+    unsigned long dt = now - lastControlTime;
+    if (dt < CONTROL_INTERVAL) return;
+    lastControlTime = now;
+
+    runSpeedLoop(speedLoop[WHEEL_LEFT], leftOutput, ticksSinceControl[WHEEL_LEFT], dt);
+    runSpeedLoop(speedLoop[WHEEL_RIGHT], rightOutput, ticksSinceControl[WHEEL_RIGHT], dt);
+    ticksSinceControl[WHEEL_LEFT] = 0;
+    ticksSinceControl[WHEEL_RIGHT] = 0;
+    driveLeft(speedLoop[WHEEL_LEFT].pwm);
+    driveRight(speedLoop[WHEEL_RIGHT].pwm);
+}
+
+void MotorController::runSpeedLoop(SpeedLoop& wheel, int setpoint, unsigned int ticks, unsigned long dt) {
+    // Single-channel encoders can't tell direction, so the wheel is
+    // taken to turn the way it is being driven
+    long speed = (long)ticks * 1000L / (long)dt;
+    wheel.measured = wheel.pwm < 0 ? -speed : speed;
+
+    int error = setpoint - wheel.measured;
+    wheel.peakError = max(wheel.peakError, abs(error));
+
+    if (setpoint == 0) {
+        wheel.integral = 0;
+        wheel.pwm = 0;
+        return;
+    }
+
+    long integral = wheel.integral + (long)ki * error * (long)dt / 1000L;
+    long output = ((long)feedForward * setpoint + (long)kp * error + integral) / 256;
+    // Hold the integral while saturated, so it does not wind up
+    if (output > -255 && output < 255) wheel.integral = integral;
+
+    // Never drive against the setpoint, the encoders would misread it
+    if (setpoint > 0) wheel.pwm = constrain(output, 0L, 255L);
+    else wheel.pwm = constrain(output, -255L, 0L);
+}
+
+WheelTelemetry MotorController::getTelemetry(Wheel wheel) {
+    WheelTelemetry telemetry;
+    telemetry.setpoint = wheel == WHEEL_LEFT ? leftOutput : rightOutput;
+    telemetry.measured = speedLoop[wheel].measured;
+    telemetry.pwm = speedLoop[wheel].pwm;
+    telemetry.peakError = speedLoop[wheel].peakError;
+    return telemetry;
+}
+
+void MotorController::clearPeakErrors() {
+    speedLoop[WHEEL_LEFT].peakError = 0;
+    speedLoop[WHEEL_RIGHT].peakError = 0;
+}
+
+// PWM actually driving the wheel, from the ramp or the speed loop
+int MotorController::getAppliedPwm(Wheel wheel) {
+    if (closedLoop) return speedLoop[wheel].pwm;
+    return wheel == WHEEL_LEFT ? leftOutput : rightOutput;
+}
+
+// Takes the new encoder edges, signed by the drive direction
+void MotorController::readEncoders() {
+    uint16_t raw[2];
+    noInterrupts();
+    raw[WHEEL_LEFT] = encoderTicks[WHEEL_LEFT];
+    raw[WHEEL_RIGHT] = encoderTicks[WHEEL_RIGHT];
+    interrupts();
+
+    for (int i = 0; i < 2; i++) {
+        uint16_t delta = raw[i] - encoderRead[i];
+        encoderRead[i] = raw[i];
+        ticksSinceControl[i] += delta;
+        int pwm = getAppliedPwm((Wheel)i);
+        if (pwm != 0) wheelDirection[i] = pwm < 0 ? -1 : 1;
+        encoderCount[i] += wheelDirection[i] * (long)delta;
+    }
+}
+
+// Without encoders, wheel speed is taken as linear in PWM above the
+// dead band, calibrated with setPwmModel()
+void MotorController::integrateModel() {
+    unsigned long now = millis();
+    unsigned long dt = now - lastTravelTime;
+    lastTravelTime = now;
+
+    for (int i = 0; i < 2; i++) {
+        int pwm = getAppliedPwm((Wheel)i);
+        if (abs(pwm) <= modelDeadband) continue;
+        long speed = (long)modelFullSpeed * (abs(pwm) - modelDeadband) / (255 - modelDeadband);
+        modelTravel[i] += (pwm < 0 ? -speed : speed) * (long)dt; // mm/s * ms = um
+    }
+}
+
+void MotorController::setTickDistance(uint16_t um) {
+    umPerTick = um;
+}
+
+void MotorController::setPwmModel(uint16_t mmPerSec, uint8_t deadband) {
+    modelFullSpeed = mmPerSec;
+    modelDeadband = min(deadband, (uint8_t)254);
+}
+
+// Signed distance the wheel has covered since start-up, in um
+long MotorController::getWheelTravel(Wheel wheel) {
+    if (!encodersAttached) return modelTravel[wheel];
+    readEncoders();
+    return encoderCount[wheel] * (long)umPerTick;
+}
+
+void MotorController::setTrackWidth(uint16_t mm) {
+    trackWidth = max(mm, (uint16_t)1);
+}
+
+uint16_t MotorController::getTrackWidth() {
+    return trackWidth;
+}
+
+// Bounds the motion just started, which then stops by itself, e.g.
+// moveForward() then limitMotion(BOUND_DISTANCE, 300) for 30cm
+void MotorController::limitMotion(MotionBound type, unsigned long amount) {
+    bound = type;
+    motionDone = false;
+    boundStartTime = millis();
+    boundStartLeft = getWheelTravel(WHEEL_LEFT);
+    boundStartRight = getWheelTravel(WHEEL_RIGHT);
+
+    if (type == BOUND_DISTANCE) {
+        boundTarget = amount * 1000UL;
+    }
+    else if (type == BOUND_ANGLE) {
+        // The wheels part by the track width for each radian turned
+        boundTarget = amount * trackWidth * 1745UL / 100UL;
+    }
+    else {
+        boundTarget = amount;
+    }
+}
+
+void MotorController::checkBound() {
+    unsigned long progress;
+    if (bound == BOUND_TIME) {
+        progress = millis() - boundStartTime;
+    }
+    else {
+        // Count the ramp down as covered already, so the wheels come
+        // to rest at the bound rather than past it
+        long left = abs(getWheelTravel(WHEEL_LEFT) - boundStartLeft) + brakingTravel(WHEEL_LEFT);
+        long right = abs(getWheelTravel(WHEEL_RIGHT) - boundStartRight) + brakingTravel(WHEEL_RIGHT);
+        if (bound == BOUND_DISTANCE) progress = (left + right) / 2;
+        else progress = left + right; // Spinning, the wheels move apart
+    }
+    if (progress < boundTarget) return;
+
+    bound = BOUND_NONE;
+    motionDone = true;
+    applyWheelSpeeds(0, 0);
+}
+
+// Estimated um a wheel still travels while ramping down to a stop
+long MotorController::brakingTravel(Wheel wheel) {
+    if (decelRate == 0) return 0;
+    long command = abs(wheel == WHEEL_LEFT ? leftOutput : rightOutput);
+    long speed; // mm/s
+    if (closedLoop) {
+        speed = command * umPerTick / 1000;
+    }
+    else {
+        if (command <= modelDeadband) return 0;
+        command -= modelDeadband;
+        speed = (long)modelFullSpeed * command / (255 - modelDeadband);
+    }
+    // Speed falls linearly to zero over command / decelRate seconds
+    return speed * (command * 1000L / decelRate) / 2;
+}
+
+bool MotorController::isBounded() {
+    return bound != BOUND_NONE;
+}
+
+// True once after a bounded motion reached its bound and came to rest
+bool MotorController::motionCompleted() {
+    if (!motionDone || isRamping()) return false;
+    motionDone = false;
+    return true;
+}
+
+void MotorController::setTrim(Wheel wheel, int8_t offset, uint16_t gainQ8, uint8_t deadband) {
+    trim[wheel].offset = offset;
+    trim[wheel].gain = gainQ8;
+    trim[wheel].deadband = min(deadband, (uint8_t)254);
+    refreshOutputs();
+}
+
+MotorTrim MotorController::getTrim(Wheel wheel) {
+    return trim[wheel];
+}
+
+// Battery sense through a divider on an analog pin, fullScaleMv being
+// the battery voltage that reads as 1023
+void MotorController::attachBattery(uint8_t pin, uint16_t fullScaleMv) {
+    batteryPin = pin;
+    batteryFullScale = fullScaleMv;
+    batteryAttached = true;
+    batteryVoltage = 0;
+    lastBatteryTime = millis();
+    readBattery();
+}
+
+// Returns true when the compensation changed
+bool MotorController::readBattery() {
+    uint16_t sample = (uint32_t)analogRead(batteryPin) * batteryFullScale / 1023;
+    // Motor current makes the pack voltage noisy, so average it
+    if (batteryVoltage == 0) batteryVoltage = sample;
+    else batteryVoltage += ((int32_t)sample - batteryVoltage) / 8;
+    return updateBatteryScale();
+}
+
+bool MotorController::updateBatteryScale() {
+    uint16_t scale = 256;
+    // Far below nominal means no pack, e.g. running from USB
+    if (nominalVoltage > 0 && batteryVoltage > nominalVoltage / 2) {
+        scale = (uint32_t)nominalVoltage * 256 / batteryVoltage;
+    }
+    if (scale == batteryScale) return false;
+    batteryScale = scale;
+    return true;
+}
+
+uint16_t MotorController::getBatteryVoltage() {
+    return batteryAttached ? batteryVoltage : 0;
+}
+
+void MotorController::setNominalVoltage(uint16_t mv) {
+    nominalVoltage = mv;
+    if (updateBatteryScale()) refreshOutputs();
+}
+
+uint16_t MotorController::getNominalVoltage() {
+    return nominalVoltage;
+}
+
+void MotorController::saveCalibration() {
+    int address = CALIBRATION_ADDRESS;
+    EEPROM.update(address++, CALIBRATION_MAGIC);
+    EEPROM.put(address, trim);
+    address += sizeof(trim);
+    EEPROM.put(address, nominalVoltage);
+}
+
+// Returns false, leaving the calibration alone, if none was saved
+bool MotorController::loadCalibration() {
+    int address = CALIBRATION_ADDRESS;
+    if (EEPROM.read(address++) != CALIBRATION_MAGIC) return false;
+    EEPROM.get(address, trim);
+    address += sizeof(trim);
+    EEPROM.get(address, nominalVoltage);
+    updateBatteryScale();
+    refreshOutputs();
+    return true;
+}
+
+void MotorController::resetCalibration() {
+    for (int i = 0; i < 2; i++) {
+        trim[i].offset = 0;
+        trim[i].gain = 256;
+        trim[i].deadband = 0;
+    }
+    nominalVoltage = 0;
+    batteryScale = 256;
+    refreshOutputs();
+}
+
+// Current sense through the shunt on the bridge's sense pins, fullScaleMa
+// being the current that reads as 1023
+void MotorController::attachCurrentSense(uint8_t pin, uint16_t fullScaleMa) {
+    currentPin = pin;
+    currentFullScale = fullScaleMa;
+    currentAttached = true;
+    currentMonitor.reset();
+    lastCurrentTime = millis();
+}
+
+void MotorController::setStallLimits(uint16_t stallMa, unsigned int stallMs, uint16_t peakMa) {
+    currentMonitor.setLimits(stallMa, min(stallMs / CURRENT_INTERVAL, 255UL), peakMa);
+}
+
+void MotorController::setStallBackoff(unsigned int ms) {
+    stallBackoff = ms;
+}
+
+// Cuts the drive and reverses at half the commanded speed for a moment,
+// easing off whatever the wheels are pushing against
+void MotorController::handleStall() {
+    stallCount++;
+    int left = -leftTarget / 2;
+    int right = -rightTarget / 2;
+    stop(STOP_COAST);
+    if (stallBackoff == 0 || (left == 0 && right == 0)) return;
+    setWheelSpeeds(left, right);
+    limitMotion(BOUND_TIME, stallBackoff);
+}
+
+// Windowed average while driving, 0 when stopped
+uint16_t MotorController::getCurrent() {
+    return currentMonitor.getAverage();
+}
+
+// Counts every stall, so each user of it can tell when a new one happened
+uint8_t MotorController::getStallCount() {
+    return stallCount;
 }
\ No newline at end of file
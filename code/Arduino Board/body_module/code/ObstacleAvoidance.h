@@ -3,17 +3,115 @@
 
 #include "MotorController.h"
 #include "UltrasonicSensor.h"
+#include "UltrasonicArray.h"
+
+enum ManeuverAction {
+    MANEUVER_STOP,
+    MANEUVER_BACKWARD,
+    MANEUVER_ROTATE,       // Towards the side picked for the escape
+    MANEUVER_ROTATE_LEFT,
+    MANEUVER_ROTATE_RIGHT
+};
+
+enum AvoidanceMode {
+    AVOID_FIXED, // Fixed distance thresholds
+    AVOID_TTC    // Speed-scaled thresholds plus time-to-collision
+};
+
+enum ApproachZone {
+    ZONE_CLEAR,
+    ZONE_SLOW,
+    ZONE_TURN,
+    ZONE_STOP,
+    ZONE_CRITICAL
+};
+
+struct ManeuverPhase {
+    ManeuverAction action;
+    unsigned int duration; // ms
+};
+
+struct EscapeRecord {
+    unsigned long time; // millis() when the escape started
+    bool rotatedLeft;
+    uint8_t level;      // Escalation applied, 0 for a plain escape
+    bool cleared;       // No further escape followed within the window
+};
 
 class ObstacleAvoidance {
   private:
     MotorController* motors;
     UltrasonicSensor* sensor;
+    UltrasonicArray* sideSensors;
     bool isEnabled;
-    float stopDistance;
-    float turnDistance;
-    float criticalDistance;
+    bool navigating;
+    uint16_t stopDistance;     // mm
+    uint16_t turnDistance;     // mm
+    uint16_t criticalDistance; // mm
+    uint16_t slowDistance;     // mm, TTC mode only
     unsigned long lastCheckTime;
     const unsigned long CHECK_INTERVAL = 100; // 100ms between checks
+
+    // Time-to-collision mode
+    AvoidanceMode mode;
+    unsigned int slowTime;  // ms
+    unsigned int turnTime;  // ms
+    unsigned int stopTime;  // ms
+    int closingSpeed;       // mm/s, positive when approaching
+    uint16_t lastRangeMm;
+    unsigned long lastRangeTime;
+    const int REFERENCE_SPEED = 200;      // Speed the base distances are tuned for
+    const int MIN_CLOSING_SPEED = 20;     // mm/s, below this TTC is ignored
+    const unsigned long MAX_RANGE_GAP = 500; // ms, older samples restart the estimate
+    ApproachZone approachZone;
+    unsigned long zoneSince;
+    const unsigned long ZONE_HOLD_TIME = 300; // ms before easing off to a milder zone
+
+    // Timed escape maneuver, advanced from check()/navigate()
+    static const int MAX_PHASES = 4;
+    ManeuverPhase phases[MAX_PHASES];
+    int phaseCount;
+    int phaseIndex;
+    unsigned long phaseStart;
+
+    // Heading handoff, e.g. from an arm-mounted sweep scan
+    bool scanOnStop;
+    bool awaitingHeading;
+    unsigned long headingRequestTime;
+    unsigned int turnRate; // deg/s when rotating at REFERENCE_SPEED
+    unsigned long headingTimeout; // ms before falling back to a plain escape
+
+    // Escape memory, escapes that follow each other closely escalate
+    static const int HISTORY_SIZE = 8;
+    static const uint8_t MAX_ESCALATION = 3;
+    EscapeRecord history[HISTORY_SIZE];
+    uint8_t historyHead;
+    uint8_t historyCount;
+    uint8_t escalation;
+    bool escapeLeft;
+    bool episodeActive;
+    bool episodeFirstLeft;
+    unsigned long episodeStart;
+    unsigned long lastEscapeEnd;
+    unsigned int episodeCount;
+    unsigned long lastTimeToClear;
+    unsigned long maxTimeToClear;
+    const unsigned long ESCAPE_WINDOW = 4000;   // ms, an escape sooner than this is a repeat
+    const unsigned int ESCALATED_BACKUP = 1500; // ms
+
+    // Motor stalls are obstacles the sensor missed, e.g. low ones
+    uint8_t seenStalls;
+
+    void startEscape(const ManeuverPhase* sequence, int count);
+    void trackEpisode();
+    bool newStall();
+    void turnAway();
+    void startManeuver(const ManeuverPhase* sequence, int count);
+    void applyPhase();
+    void updateManeuver();
+    void trackClosingSpeed();
+    uint16_t scaledDistance(uint16_t base);
+    ApproachZone classify(uint16_t distance);
     
   public:
     ObstacleAvoidance(MotorController* m, UltrasonicSensor* s);
@@ -21,9 +119,36 @@ class ObstacleAvoidance {
     void enable();
     void disable();
     bool isActive();
-    void setDistances(float stop, float turn, float critical);
+    void startNavigation();
+    void stopNavigation();
+    bool isNavigating();
+    void update();
+    void setDistances(uint16_t stopMm, uint16_t turnMm, uint16_t criticalMm);
+    void setStoppingDistance(uint16_t stoppingMm);
+    void setSensorArray(UltrasonicArray* array);
+    void setMode(AvoidanceMode m);
+    AvoidanceMode getMode();
+    void setSlowDistance(uint16_t slowMm);
+    void setTimeToCollision(unsigned int slowMs, unsigned int turnMs, unsigned int stopMs);
+    void updateClosingSpeed(uint16_t distanceMm, unsigned long timestamp);
+    int getClosingSpeed();
+    unsigned long getTimeToCollision(uint16_t distanceMm);
     bool check();
     void navigate();
+    bool isManeuvering();
+    void abortManeuver();
+    void setScanOnStop(bool enabled);
+    bool isAwaitingHeading();
+    void setHeadingTimeout(unsigned long ms);
+    void setTurnRate(unsigned int degPerSec);
+    void steerTo(int heading);
+    uint8_t getEscalation();
+    unsigned int getEpisodeCount();
+    unsigned long getLastTimeToClear();
+    unsigned long getMaxTimeToClear();
+    int getHistoryCount();
+    EscapeRecord getHistory(int index);
+    void clearStats();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "Odometry.h"
+
+Odometry::Odometry(MotorController* m) {
+    motors = m;
+    x = 0;
+    y = 0;
+    heading = 0;
+    headingRemainder = 0;
+    lastLeft = 0;
+    lastRight = 0;
+    lastUpdateTime = 0;
+}
+
+void Odometry::begin() {
+    reset();
+}
+
+void Odometry::update() {
+    unsigned long currentTime = millis();
+    if (currentTime - lastUpdateTime < UPDATE_INTERVAL) return;
+    lastUpdateTime = currentTime;
+
+    long left = motors->getWheelTravel(WHEEL_LEFT);
+    long right = motors->getWheelTravel(WHEEL_RIGHT);
+    long stepLeft = left - lastLeft;
+    long stepRight = right - lastRight;
+    lastLeft = left;
+    lastRight = right;
+
+    // A loop() held up by a delay hands over one long step. Integrate it
+    // in pieces no wheel moves more than MAX_STEP in, which keeps the
+    // heading product within 32 bits and follows the curve more closely
+    long largest = max(abs(stepLeft), abs(stepRight));
+    for (long pieces = largest / MAX_STEP + 1; pieces > 1; pieces--) {
+        long pieceLeft = stepLeft / pieces;
+        long pieceRight = stepRight / pieces;
+        integrate(pieceLeft, pieceRight);
+        stepLeft -= pieceLeft;
+        stepRight -= pieceRight;
+    }
+    integrate(stepLeft, stepRight);
+}
+
+void Odometry::integrate(long left, long right) {
+    // The heading turns by (right - left) / track radians, 57.30 degrees
+    // each; the division remainder carries over so turns don't drift
+    long numerator = (right - left) * 5730L + headingRemainder;
+    long denominator = (long)motors->getTrackWidth() * 100L;
+    long turn = numerator / denominator;
+    headingRemainder = numerator - turn * denominator;
+
+    // Advance along the mean heading of the step. The Q14 products take
+    // center in 16 um units, with what is left over added on its own,
+    // so a step up to 2 m fits 32 bits, far beyond MAX_STEP
+    long center = (left + right) / 2;
+    long coarse = center / 16;
+    long fine = center - coarse * 16;
+    long midHeading = (heading + turn / 2) / 10;
+    int16_t cosine = fixedCos(midHeading);
+    int16_t sine = fixedSin(midHeading);
+    x += coarse * cosine / (TRIG_ONE / 16) + fine * cosine / TRIG_ONE;
+    y += coarse * sine / (TRIG_ONE / 16) + fine * sine / TRIG_ONE;
+
+    heading += turn;
+    if (heading > 180000L) heading -= 360000L;
+    else if (heading < -180000L) heading += 360000L;
+}
+
+void Odometry::reset() {
+    x = 0;
+    y = 0;
+    heading = 0;
+    headingRemainder = 0;
+    lastLeft = motors->getWheelTravel(WHEEL_LEFT);
+    lastRight = motors->getWheelTravel(WHEEL_RIGHT);
+}
+
+long Odometry::getX() {
+    return x / 1000;
+}
+
+long Odometry::getY() {
+    return y / 1000;
+}
+
+int Odometry::getHeading() {
+    return heading / 10;
+}
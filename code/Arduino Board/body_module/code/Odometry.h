@@ -0,0 +1,33 @@
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#include "MotorController.h"
+#include "FixedTrig.h"
+
+// Dead-reckoned pose from the wheel travel MotorController reports.
+// x points along the heading at the last reset, y to its left, and
+// the heading grows counterclockwise
+class Odometry {
+  private:
+    MotorController* motors;
+    long x, y;           // um
+    long heading;        // millidegrees, -180000 to 180000
+    long headingRemainder;
+    long lastLeft, lastRight; // Wheel travel at the last update, um
+    unsigned long lastUpdateTime;
+    const unsigned long UPDATE_INTERVAL = 20; // ms between pose updates
+    const long MAX_STEP = 100000;             // um per wheel in one integration
+
+    void integrate(long left, long right);
+
+  public:
+    Odometry(MotorController* m);
+    void begin();
+    void update();
+    void reset();
+    long getX();      // mm
+    long getY();      // mm
+    int getHeading(); // centidegrees, -18000 to 18000
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef PIN_CHANGE_H
+#define PIN_CHANGE_H
+
+#include <Arduino.h>
+
+// Pin change interrupts for pins without an external interrupt, shared
+// by the wheel encoders and the side echo pins. No vector is claimed
+// until the sketch asks for one with PIN_CHANGE_ISR(group), so other
+// pin change users such as SoftwareSerial still link. On the Uno group
+// 0 is pins 8-13, 1 is A0-A5 and 2 is pins 0-7
+class PinChange {
+  private:
+    static const uint8_t MAX_HANDLERS = 4;
+    struct Handler {
+        uint8_t group;
+        void (*function)();
+    };
+    static Handler handlers[MAX_HANDLERS];
+    static volatile uint8_t handlerCount;
+    static uint8_t claimedGroups; // Bit per group with its ISR defined
+
+  public:
+    static bool claim(uint8_t group);
+    static bool attach(uint8_t pin, void (*function)());
+    static void detach(uint8_t pin);
+    static void dispatch(uint8_t group); // Called from the claimed ISRs
+};
+
+// Defines the pin change ISR of one group and hands it to PinChange,
+// e.g. PIN_CHANGE_ISR(1); in the sketch for pins A0-A5
+#define PIN_CHANGE_ISR(group) \
+    ISR(PCINT##group##_vect) { PinChange::dispatch(group); } \
+    static const bool pinChangeClaimed##group = PinChange::claim(group)
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef STOP_CALIBRATION_H
+#define STOP_CALIBRATION_H
+
+#include "MotorController.h"
+#include "UltrasonicSensor.h"
+
+enum CalibrationState {
+    CAL_IDLE,
+    CAL_BACKING,   // Reversing until far enough from the wall
+    CAL_SETTLING,  // Standing still before the next run
+    CAL_APPROACH,  // Driving at the run speed towards the wall
+    CAL_STOPPING,  // Stopped, waiting to come to rest
+    CAL_DONE,
+    CAL_FAILED
+};
+
+// Measures stopping distance against a wall ahead, at several speeds.
+// Each run drives at the wall, stops once the front sensor reads the
+// trigger distance, and takes the distance still covered after that
+class StopCalibration {
+  private:
+    MotorController* motors;
+    UltrasonicSensor* sensor;
+    CalibrationState state;
+    StopMode stopMode;
+    static const int RUN_COUNT = 4;
+    uint16_t stoppingDistance[RUN_COUNT]; // mm
+    int run;
+    int savedSpeed;
+    uint16_t stopFrom; // mm, reading that triggered the stop
+    unsigned long stateStart;
+    unsigned long lastReadingTime;
+    const uint16_t TRIGGER_DISTANCE = 1000; // mm, stop when closer
+    const uint16_t START_DISTANCE = 1300;   // mm, back up to at least this
+    const int BACKING_SPEED = 150;
+    const unsigned long SETTLE_TIME = 600;  // ms at rest before measuring
+    const unsigned long STATE_TIMEOUT = 8000;
+
+    void setState(CalibrationState next);
+    bool freshReading(RangeReading& reading);
+
+  public:
+    StopCalibration(MotorController* m, UltrasonicSensor* s);
+    void start(StopMode mode);
+    void update();
+    void abort();
+    bool isRunning();
+    CalibrationState getState();
+    int getRunCount();
+    int getRunSpeed(int index);
+    uint16_t getStoppingDistance(int index);
+    uint16_t getStoppingDistanceAt(int speed);
+};
+
+#endif
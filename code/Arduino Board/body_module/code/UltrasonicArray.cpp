@@ -0,0 +1,106 @@
+#include "UltrasonicArray.h"
+
+UltrasonicArray::UltrasonicArray() {
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        sensors[i] = nullptr;
+    }
+    current = SENSOR_FRONT;
+    pinging = false;
+    lastEchoTime = 0;
+    guardTime = 20; // Lets stray echoes die out before the next ping
+    rateWindowStart = 0;
+    rateWindowCount = 0;
+    updateRate = 0;
+}
+
+void UltrasonicArray::attach(SensorDirection direction, UltrasonicSensor* sensor) {
+    sensors[direction] = sensor;
+}
+
+void UltrasonicArray::begin() {
+    // The array owns the ping schedule; sensors only fire when told to
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        if (sensors[i] != nullptr) {
+            sensors[i]->setAutoTrigger(false);
+        }
+    }
+    rateWindowStart = millis();
+}
+
+void UltrasonicArray::setGuardTime(unsigned long ms) {
+    guardTime = ms;
+}
+
+void UltrasonicArray::advance() {
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        current = (current + 1) % SENSOR_COUNT;
+        if (sensors[current] != nullptr) return;
+    }
+}
+
+void UltrasonicArray::update() {
+    unsigned long currentTime = millis();
+
+    if (pinging) {
+        sensors[current]->update();
+        if (sensors[current]->isBusy()) return;
+
+        pinging = false;
+        lastEchoTime = currentTime;
+        rateWindowCount++;
+    }
+
+    if (currentTime - rateWindowStart >= RATE_WINDOW) {
+        updateRate = (rateWindowCount * 1000UL) / (currentTime - rateWindowStart);
+        rateWindowCount = 0;
+        rateWindowStart = currentTime;
+    }
+
+    // Only one sensor is ever in flight, and never before the guard
+    // time has passed since the previous echo
+    if (currentTime - lastEchoTime < guardTime) return;
+
+    advance();
+    if (sensors[current] == nullptr) return;
+
+    sensors[current]->startPing();
+    pinging = true;
+}
+
+uint16_t UltrasonicArray::getDistanceMm(SensorDirection direction) {
+    if (sensors[direction] == nullptr) return 0;
+    return sensors[direction]->getFilteredDistanceMm(3);
+}
+
+bool UltrasonicArray::isValid(SensorDirection direction) {
+    if (sensors[direction] == nullptr) return false;
+    return sensors[direction]->isValid();
+}
+
+uint16_t UltrasonicArray::getClearanceMm(SensorDirection direction) {
+    UltrasonicSensor* sensor = sensors[direction];
+    if (sensor == nullptr) return 0;
+
+    RangeReading reading = sensor->getReading();
+    if (reading.status == RANGE_VALID) return sensor->getFilteredDistanceMm(3);
+    if (reading.status == RANGE_OUT_OF_RANGE) return sensor->getMaxRange();
+    return 0; // Unknown counts as blocked
+}
+
+void UltrasonicArray::getDistancesMm(uint16_t distances[SENSOR_COUNT]) {
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        distances[i] = getClearanceMm((SensorDirection)i);
+    }
+}
+
+SensorDirection UltrasonicArray::getClearestSide() {
+    // Ties go right, matching the single sensor behavior
+    if (getClearanceMm(SENSOR_LEFT) > getClearanceMm(SENSOR_RIGHT)) {
+        return SENSOR_LEFT;
+    }
+    return SENSOR_RIGHT;
+}
+
+unsigned int UltrasonicArray::getUpdateRate() {
+    return updateRate;
+}
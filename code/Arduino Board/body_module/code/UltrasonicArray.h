@@ -0,0 +1,43 @@
+#ifndef ULTRASONIC_ARRAY_H
+#define ULTRASONIC_ARRAY_H
+
+#include "UltrasonicSensor.h"
+
+enum SensorDirection {
+    SENSOR_FRONT,
+    SENSOR_LEFT,
+    SENSOR_RIGHT,
+    SENSOR_COUNT
+};
+
+class UltrasonicArray {
+  private:
+    UltrasonicSensor* sensors[SENSOR_COUNT];
+    int current;
+    bool pinging;
+    unsigned long lastEchoTime;
+    unsigned long guardTime;
+
+    // Aggregate update rate, measured over one second windows
+    unsigned long rateWindowStart;
+    unsigned int rateWindowCount;
+    unsigned int updateRate;
+    const unsigned long RATE_WINDOW = 1000;
+
+    void advance();
+
+  public:
+    UltrasonicArray();
+    void attach(SensorDirection direction, UltrasonicSensor* sensor);
+    void begin();
+    void update();
+    void setGuardTime(unsigned long ms);
+    uint16_t getDistanceMm(SensorDirection direction);
+    bool isValid(SensorDirection direction);
+    uint16_t getClearanceMm(SensorDirection direction);
+    void getDistancesMm(uint16_t distances[SENSOR_COUNT]);
+    SensorDirection getClearestSide();
+    unsigned int getUpdateRate();
+};
+
+#endif
@@ -1,38 +1,282 @@
 #include "UltrasonicSensor.h"
+#include "PinChange.h"
+
+UltrasonicSensor* UltrasonicSensor::activeSensor = nullptr;
 
 UltrasonicSensor::UltrasonicSensor(uint8_t trig, uint8_t echo) {
     trigPin = trig;
     echoPin = echo;
     lastReadTime = 0;
-    lastDistance = 0;
+    lastDistanceMm = 0;
+    lastReading.distanceMm = 0;
+    lastReading.status = RANGE_NO_ECHO;
+    lastReading.timestamp = 0;
+    maxRangeMm = 4000; // HC-SR04 rated range
+    setSpeedOfSound(SPEED_OF_SOUND_DEFAULT);
+    filterMode = FILTER_MEDIAN;
+    emaAlpha = 77; // ~0.3
+    clearFilter();
+    useInterrupt = false;
+    echoInput = nullptr;
+    echoMask = 0;
+    autoTrigger = true;
+    pingPending = false;
+    triggerTime = 0;
+    echoLevel = LOW;
+    echoStarted = false;
+    echoReceived = false;
+    echoStart = 0;
+    echoDuration = 0;
 }
 
 void UltrasonicSensor::begin() {
     pinMode(trigPin, OUTPUT);
     pinMode(echoPin, INPUT);
+    digitalWrite(trigPin, LOW);
+
+    // Timestamp the echo edges in an interrupt: the external one when
+    // the pin has it (pin 2 is INT0 on the Uno), else a pin change
+    // interrupt if the sketch claimed the pin's group. Only a pin with
+    // neither falls back to pulseIn(), which blocks for the whole echo
+    echoInput = portInputRegister(digitalPinToPort(echoPin));
+    echoMask = digitalPinToBitMask(echoPin);
+    int interruptNum = digitalPinToInterrupt(echoPin);
+    if (interruptNum != NOT_AN_INTERRUPT) {
+        attachInterrupt(interruptNum, echoISR, CHANGE);
+        useInterrupt = true;
+    }
+    else {
+        useInterrupt = PinChange::attach(echoPin, echoISR);
+    }
 }
 
-float UltrasonicSensor::getDistance() {
-    unsigned long currentTime = millis();
-    if (currentTime - lastReadTime >= READ_INTERVAL) {
-        digitalWrite(trigPin, LOW);
-        delayMicroseconds(2);
-        digitalWrite(trigPin, HIGH);
-        delayMicroseconds(10);
-        digitalWrite(trigPin, LOW);
-        
-        long duration = pulseIn(echoPin, HIGH);
-        lastDistance = duration * 0.034 / 2;
-        lastReadTime = currentTime;
+void UltrasonicSensor::echoISR() {
+    if (activeSensor != nullptr) {
+        activeSensor->handleEcho();
+    }
+}
+
+void UltrasonicSensor::handleEcho() {
+    // Edges on other sensors' echo pins share this handler, so only
+    // react when our own pin actually changed level
+    // Read the port directly, digitalRead() is slow for an ISR
+    uint8_t level = (*echoInput & echoMask) ? HIGH : LOW;
+    if (level == echoLevel) return;
+    echoLevel = level;
+
+    unsigned long now = micros();
+    if (level == HIGH) {
+        echoStart = now;
+        echoStarted = true;
+    }
+    else if (echoStarted) {
+        echoDuration = now - echoStart;
+        echoStarted = false;
+        echoReceived = true;
     }
-    return lastDistance;
+}
+
+void UltrasonicSensor::trigger() {
+    digitalWrite(trigPin, LOW);
+    delayMicroseconds(2);
+    digitalWrite(trigPin, HIGH);
+    delayMicroseconds(10);
+    digitalWrite(trigPin, LOW);
+}
+
+void UltrasonicSensor::startPing() {
+    lastReadTime = millis();
+
+    if (!useInterrupt) {
+        trigger();
+        unsigned long duration = pulseIn(echoPin, HIGH, echoTimeout);
+        if (duration > 0) {
+            recordEcho(duration);
+        }
+        else {
+            // A pin still high means the echo outlasted the timeout
+            recordFailure(digitalRead(echoPin) == HIGH ? RANGE_OUT_OF_RANGE : RANGE_NO_ECHO);
+        }
+        return;
+    }
+
+    noInterrupts();
+    echoLevel = digitalRead(echoPin);
+    echoStarted = false;
+    echoReceived = false;
+    activeSensor = this;
+    interrupts();
+
+    trigger();
+    triggerTime = micros();
+    pingPending = true;
+}
+
+void UltrasonicSensor::setAutoTrigger(bool enabled) {
+    autoTrigger = enabled;
+}
+
+bool UltrasonicSensor::isBusy() {
+    return pingPending;
+}
+
+void UltrasonicSensor::setMaxRange(uint16_t rangeMm) {
+    maxRangeMm = rangeMm;
+    updateEchoTimeout();
+}
+
+uint16_t UltrasonicSensor::getMaxRange() {
+    return maxRangeMm;
+}
+
+void UltrasonicSensor::setSpeedOfSound(uint32_t speed) {
+    // speed is in mm/s, so half of it in mm/us is speed / 2000000,
+    // and 65536 / 2000000 reduces to 4096 / 125000
+    halfSpeedQ16 = (speed * 4096UL + 62500) / 125000;
+    updateEchoTimeout();
+}
+
+void UltrasonicSensor::updateEchoTimeout() {
+    // Round trip time for the maximum range plus the burst latency
+    echoTimeout = ((uint32_t)maxRangeMm * 65536UL) / halfSpeedQ16 + ECHO_LATENCY;
+}
+
+void UltrasonicSensor::setTemperature(int8_t celsius) {
+    // c = 331.3 + 0.606 * T m/s
+    setSpeedOfSound(331300L + 606L * celsius);
+}
+
+void UltrasonicSensor::disableTemperatureCompensation() {
+    setSpeedOfSound(SPEED_OF_SOUND_DEFAULT);
+}
+
+void UltrasonicSensor::recordEcho(unsigned long duration) {
+    uint32_t distance = ((uint32_t)duration * halfSpeedQ16 + 32768UL) >> 16;
+    lastReading.distanceMm = distance > 0xFFFF ? 0xFFFF : distance;
+    lastReading.timestamp = millis();
+
+    if (distance < MIN_RANGE_MM) {
+        lastReading.status = RANGE_TOO_CLOSE;
+    }
+    else if (distance > maxRangeMm) {
+        lastReading.status = RANGE_OUT_OF_RANGE;
+    }
+    else {
+        lastReading.status = RANGE_VALID;
+        lastDistanceMm = distance;
+        addSample(distance);
+    }
+}
+
+void UltrasonicSensor::addSample(uint16_t distanceMm) {
+    sampleBuffer[sampleHead] = distanceMm;
+    sampleHead = (sampleHead + 1) % FILTER_SIZE;
+    if (sampleCount < FILTER_SIZE) sampleCount++;
+
+    int32_t sample = (int32_t)distanceMm << 4;
+    if (sampleCount == 1) {
+        emaDistance = sample;
+    }
+    else {
+        emaDistance += ((sample - emaDistance) * emaAlpha) / 256;
+    }
+}
+
+void UltrasonicSensor::recordFailure(RangeStatus status) {
+    lastReading.distanceMm = 0;
+    lastReading.status = status;
+    lastReading.timestamp = millis();
+}
+
+void UltrasonicSensor::update() {
+    // Collect the result of the ping in flight, if any
+    if (pingPending) {
+        if (echoReceived) {
+            noInterrupts();
+            unsigned long duration = echoDuration;
+            interrupts();
+            recordEcho(duration);
+            pingPending = false;
+        }
+        else if (micros() - triggerTime >= echoTimeout) {
+            recordFailure(echoStarted ? RANGE_OUT_OF_RANGE : RANGE_NO_ECHO);
+            pingPending = false;
+        }
+        else {
+            return;
+        }
+    }
+
+    if (autoTrigger && millis() - lastReadTime >= READ_INTERVAL) {
+        startPing();
+    }
+}
+
+uint16_t UltrasonicSensor::getDistanceMm() {
+    update();
+    return lastDistanceMm;
+}
+
+uint16_t UltrasonicSensor::getFilteredDistanceMm(uint8_t samples) {
+    update();
+    if (sampleCount == 0) return lastDistanceMm;
+    if (filterMode == FILTER_EMA) return (emaDistance + 8) >> 4;
+
+    // Median of the newest samples, insertion sorted in a scratch copy
+    uint8_t n = constrain(samples, 1, sampleCount);
+    uint16_t window[FILTER_SIZE];
+    for (uint8_t i = 0; i < n; i++) {
+        uint16_t value = sampleBuffer[(sampleHead + FILTER_SIZE - 1 - i) % FILTER_SIZE];
+        uint8_t j = i;
+        while (j > 0 && window[j - 1] > value) {
+            window[j] = window[j - 1];
+            j--;
+        }
+        window[j] = value;
+    }
+
+    if (n % 2 == 1) return window[n / 2];
+    return (window[n / 2 - 1] + window[n / 2] + 1) / 2;
+}
+
+// Centimetre readings for display; the ranging path itself stays integer
+float UltrasonicSensor::getDistance() {
+    return getDistanceMm() / 10.0;
 }
 
 float UltrasonicSensor::getFilteredDistance(int samples) {
-    float sum = 0;
-    for (int i = 0; i < samples; i++) {
-        sum += getDistance();
-        delay(10);
+    return getFilteredDistanceMm(constrain(samples, 1, FILTER_SIZE)) / 10.0;
+}
+
+void UltrasonicSensor::setFilterMode(FilterMode mode) {
+    filterMode = mode;
+}
+
+void UltrasonicSensor::setSmoothing(uint8_t alpha) {
+    emaAlpha = max(alpha, (uint8_t)1);
+}
+
+void UltrasonicSensor::clearFilter() {
+    sampleHead = 0;
+    sampleCount = 0;
+    emaDistance = 0;
+}
+
+RangeReading UltrasonicSensor::getReading() {
+    update();
+    return lastReading;
+}
+
+bool UltrasonicSensor::isValid() {
+    return lastReading.status == RANGE_VALID;
+}
+
+const char* UltrasonicSensor::statusName(RangeStatus status) {
+    switch (status) {
+        case RANGE_VALID: return "valid";
+        case RANGE_NO_ECHO: return "no echo";
+        case RANGE_TOO_CLOSE: return "too close";
+        case RANGE_OUT_OF_RANGE: return "out of range";
     }
-    return sum / samples;
-}
\ No newline at end of file
+    return "unknown";
+}
@@ -1,6 +1,9 @@
-#include "MotorController.h"
+#include "FastMotorController.h"
 #include "UltrasonicSensor.h"
+#include "UltrasonicArray.h"
 #include "ObstacleAvoidance.h"
+#include "Odometry.h"
+#include "StopCalibration.h"
 
 // Pin definitions
 const uint8_t MOTOR1_IN1 = 3;
@@ -11,40 +14,230 @@ const uint8_t MOTOR1_ENA = 9;
 const uint8_t MOTOR2_ENB = 10;
 const uint8_t TRIG_PIN = 12;
 const uint8_t ECHO_PIN = 2;
+const uint8_t LEFT_TRIG_PIN = A0;
+const uint8_t LEFT_ECHO_PIN = A1;
+const uint8_t RIGHT_TRIG_PIN = A2;
+const uint8_t RIGHT_ECHO_PIN = A3;
+const uint8_t LEFT_ENCODER_PIN = A4;
+const uint8_t RIGHT_ENCODER_PIN = A5;
+// Battery and current sensing read A6 and A7, the analog-only pins the
+// Nano and Pro Mini break out. The Uno has no header for them and its
+// A0-A5 carry the side sensors and encoders, so both need a Nano
+const uint8_t BATTERY_PIN = A6;
+const uint16_t BATTERY_FULL_SCALE = 15000; // mV reading as 1023, 3:1 divider
+const uint8_t CURRENT_PIN = A7;
+const uint16_t CURRENT_FULL_SCALE = 10000; // mA reading as 1023, 0.5 ohm shunt
+
+// The encoders and side echo pins use the A0-A5 pin change interrupt,
+// the only pin change vector the sketch takes over, leaving the others
+// to libraries such as SoftwareSerial
+static_assert(digitalPinToPCICRbit(LEFT_ENCODER_PIN) == 1 && digitalPinToPCICRbit(RIGHT_ENCODER_PIN) == 1 &&
+              digitalPinToPCICRbit(LEFT_ECHO_PIN) == 1 && digitalPinToPCICRbit(RIGHT_ECHO_PIN) == 1,
+              "Encoder and side echo pins need the A0-A5 pin change interrupt claimed below");
+PIN_CHANGE_ISR(1);
 
 // Enable or disable command printing and invalid command handling
 bool enableCommandFeedback = false;
 bool enableSerialOutput = false; // Set this to false to disable all serial printing
 
+// Set to true when left and right ultrasonic sensors are fitted
+bool useSideSensors = false;
+
+// Set to true when wheel encoders are fitted, enables the speed loop
+bool useEncoders = false;
+
+// Set to true when the battery divider is wired to BATTERY_PIN (Nano only)
+bool useBatterySense = false;
+
+// Set to true when the L298N sense pins go through a shunt to CURRENT_PIN
+// (Nano only)
+bool useCurrentSense = false;
+
+#ifdef ARDUINO_AVR_UNO
+const bool HAS_ANALOG_ONLY_PINS = false;
+#else
+const bool HAS_ANALOG_ONLY_PINS = true;
+#endif
+
 // Create objects
-MotorController motors(MOTOR1_IN1, MOTOR1_IN2, MOTOR2_IN1, MOTOR2_IN2, MOTOR1_ENA, MOTOR2_ENB);
+FastMotorController<MOTOR1_IN1, MOTOR1_IN2, MOTOR2_IN1, MOTOR2_IN2, MOTOR1_ENA, MOTOR2_ENB> motors;
 UltrasonicSensor sensor(TRIG_PIN, ECHO_PIN);
+UltrasonicSensor leftSensor(LEFT_TRIG_PIN, LEFT_ECHO_PIN);
+UltrasonicSensor rightSensor(RIGHT_TRIG_PIN, RIGHT_ECHO_PIN);
+UltrasonicArray sonar;
 ObstacleAvoidance oa(&motors, &sensor);
+Odometry odometry(&motors);
+StopCalibration calibration(&motors, &sensor);
 
 String command = "";
+String boundedMove = ""; // Last bounded move, for its acknowledgement
+bool calibrationReportPending = false;
+uint8_t reportedStalls = 0;
+String inputBuffer = "";
+
+// Command latency, from the first byte of a command to the end of its
+// execution, and the longest loop() pass that could delay it
+unsigned long commandStartTime = 0;
+unsigned long lastCommandLatency = 0;
+unsigned long maxCommandLatency = 0;
+unsigned long lastLoopTime = 0;
+unsigned long maxLoopTime = 0;
 
 void setup() {
     Serial.begin(115200);
     motors.begin();
+    if (useEncoders) {
+        motors.attachEncoders(LEFT_ENCODER_PIN, RIGHT_ENCODER_PIN);
+    }
+    if ((useBatterySense || useCurrentSense) && !HAS_ANALOG_ONLY_PINS) {
+        Serial.println("Battery and current sense need A6/A7, which the Uno lacks");
+    }
+    else {
+        if (useBatterySense) {
+            motors.attachBattery(BATTERY_PIN, BATTERY_FULL_SCALE);
+        }
+        if (useCurrentSense) {
+            motors.attachCurrentSense(CURRENT_PIN, CURRENT_FULL_SCALE);
+        }
+    }
     sensor.begin();
+    if (useSideSensors) {
+        beginSideSensors();
+    }
     oa.begin();
+    odometry.begin();
+    inputBuffer.reserve(32);
     if (enableSerialOutput) {
         printCommands();
     }
 }
 
 void loop() {
-    // Check obstacle avoidance if enabled
-    if (oa.isActive()) {
-        oa.check();
+    // Slew the motor outputs toward their targets, then track the pose
+    motors.update();
+    odometry.update();
+    if (motors.getStallCount() != reportedStalls) {
+        reportedStalls = motors.getStallCount();
+        boundedMove = "stall back-off";
+        if (enableSerialOutput) Serial.println("Stall, backing off at " + String(motors.getCurrent()) + " mA");
+    }
+    // The controller driving a bounded move waits on this, so it is sent
+    // whatever enableSerialOutput says
+    if (motors.motionCompleted()) {
+        Serial.println("Done: " + boundedMove);
     }
 
-    // Read serial commands
-    if (Serial.available() > 0) {
-        command = Serial.readStringUntil('\n');
+    // Keep the ultrasonic ping cycle running
+    if (useSideSensors) {
+        sonar.update();
+    } else {
+        sensor.update();
+    }
+
+    // Obstacle avoidance and navigation run in the background
+    oa.update();
+    calibration.update();
+    if (calibrationReportPending && !calibration.isRunning()) {
+        finishCalibration();
+        calibrationReportPending = false;
+    }
+
+    // Read serial commands without blocking
+    if (readCommand()) {
         command.trim();
         executeCommand(command);
+
+        lastCommandLatency = micros() - commandStartTime;
+        maxCommandLatency = max(maxCommandLatency, lastCommandLatency);
     }
+
+    unsigned long now = micros();
+    if (lastLoopTime != 0) {
+        maxLoopTime = max(maxLoopTime, now - lastLoopTime);
+    }
+    lastLoopTime = now;
+}
+
+// Collects serial input; returns true once a full line is in command
+bool readCommand() {
+    while (Serial.available() > 0) {
+        char c = Serial.read();
+        if (inputBuffer.length() == 0) {
+            commandStartTime = micros();
+        }
+        if (c == '\n') {
+            command = inputBuffer;
+            inputBuffer = "";
+            return true;
+        }
+        inputBuffer += c;
+    }
+    return false;
+}
+
+void beginSideSensors() {
+    // Side sensors only need short range; their echoes come in on the
+    // pin change interrupt claimed above, so pinging never blocks loop()
+    leftSensor.begin();
+    rightSensor.begin();
+    leftSensor.setMaxRange(1500);
+    rightSensor.setMaxRange(1500);
+
+    sonar.attach(SENSOR_FRONT, &sensor);
+    sonar.attach(SENSOR_LEFT, &leftSensor);
+    sonar.attach(SENSOR_RIGHT, &rightSensor);
+    sonar.begin();
+    oa.setSensorArray(&sonar);
+}
+
+// One sensor's part of the sonar report: its distance, why it has none,
+// or off when it isn't fitted, so a missing sensor can't read as 0 mm
+String sonarReading(UltrasonicSensor& ranger, bool fitted) {
+    if (!fitted) return "off";
+    RangeStatus status = ranger.getReading().status;
+    if (status != RANGE_VALID) return UltrasonicSensor::statusName(status);
+    return String(ranger.getFilteredDistanceMm(3)) + " mm";
+}
+
+// Starts a movement command by name
+void startMotion(String name) {
+    if (name == "mv") motors.moveForward();
+    else if (name == "bk") motors.moveBackward();
+    else if (name == "lt") motors.turnLeft();
+    else if (name == "rt") motors.turnRight();
+    else if (name == "rl") motors.rotateLeft();
+    else if (name == "rr") motors.rotateRight();
+}
+
+bool isMovement(String name) {
+    return name == "mv" || name == "bk" || name == "lt" || name == "rt" || name == "rl" || name == "rr";
+}
+
+// Parses "<move> <amount><unit>", e.g. "mv 30cm", "rl 90deg" or "bk 500ms".
+// The motors stop by themselves and the move is acknowledged from loop()
+void startBoundedMove(String cmd) {
+    String name = cmd.substring(0, 2);
+    String arg = cmd.substring(3);
+    unsigned long amount = arg.toInt();
+    MotionBound type;
+    if (arg.endsWith("ms")) {
+        type = BOUND_TIME;
+    } else if (arg.endsWith("cm")) {
+        type = BOUND_DISTANCE;
+        amount *= 10;
+    } else if (arg.endsWith("mm")) {
+        type = BOUND_DISTANCE;
+    } else if (arg.endsWith("deg") && name != "mv" && name != "bk") {
+        type = BOUND_ANGLE;
+    } else {
+        if (enableCommandFeedback && enableSerialOutput) {
+            Serial.println("Usage: " + name + " <n>ms, <n>cm or <n>mm, turns also <n>deg");
+        }
+        return;
+    }
+    startMotion(name);
+    motors.limitMotion(type, amount);
+    boundedMove = cmd;
 }
 
 void executeCommand(String cmd) {
@@ -73,16 +266,107 @@ void executeCommand(String cmd) {
         motors.rotateRight();
         if (enableSerialOutput) Serial.println("Rotating right");
     }
-    else if (cmd == "st") {
-        motors.stop();
+    else if (cmd.length() > 3 && cmd.charAt(2) == ' ' && isMovement(cmd.substring(0, 2))) {
+        startBoundedMove(cmd);
+    }
+    else if (cmd == "st" || cmd == "st brake" || cmd == "st coast") {
+        if (oa.isNavigating()) {
+            oa.stopNavigation();
+            if (enableSerialOutput) Serial.println("Navigation stopped");
+        }
+        oa.abortManeuver();
+        calibration.abort();
+        if (cmd == "st brake") {
+            motors.stop(STOP_BRAKE);
+        } else if (cmd == "st coast") {
+            motors.stop(STOP_COAST);
+        } else {
+            motors.stop();
+        }
         if (enableSerialOutput) Serial.println("Stopping");
     }
+    else if (cmd.startsWith("brake ")) {
+        int brakeTime = cmd.substring(6).toInt();
+        motors.setBrakeTime(brakeTime);
+        if (enableSerialOutput) Serial.println("Brake time set to: " + String(brakeTime) + " ms");
+    }
+    else if (cmd == "cal brake" || cmd == "cal coast") {
+        startCalibration(cmd == "cal brake" ? STOP_BRAKE : STOP_COAST);
+    }
     // Speed commands
     else if (cmd.startsWith("spd ")) {
         int speed = cmd.substring(4).toInt();
         motors.setSpeed(speed);
         if (enableSerialOutput) Serial.println("Speed set to: " + String(speed));
     }
+    else if (cmd.startsWith("ramp ")) {
+        setMotorRamp(cmd.substring(5));
+    }
+    else if (cmd == "pose") {
+        // A query, so it is answered even with serial output off
+        Serial.println("Pose: x " + String(odometry.getX()) + " mm, y " + String(odometry.getY()) + " mm, heading " +
+                       String(odometry.getHeading() / 100.0) + " deg");
+    }
+    else if (cmd == "pose reset") {
+        odometry.reset();
+        if (enableSerialOutput) Serial.println("Pose reset");
+    }
+    else if (cmd.startsWith("pose track ")) {
+        int track = cmd.substring(11).toInt();
+        motors.setTrackWidth(track);
+        if (enableSerialOutput) Serial.println("Track width set to: " + String(track) + " mm");
+    }
+    else if (cmd.startsWith("pose model ")) {
+        setPwmModel(cmd.substring(11));
+    }
+    else if (cmd == "enc on") {
+        bool attached = motors.setClosedLoop(true);
+        if (enableSerialOutput) {
+            Serial.println(attached ? "Speed loop on, speeds in ticks/s" : "No encoders attached");
+        }
+    }
+    else if (cmd == "enc off") {
+        motors.setClosedLoop(false);
+        if (enableSerialOutput) Serial.println("Speed loop off, speeds in PWM");
+    }
+    else if (cmd == "enc") {
+        if (enableSerialOutput) printWheelTelemetry();
+        motors.clearPeakErrors();
+    }
+    else if (cmd.startsWith("enc gains ")) {
+        setSpeedGains(cmd.substring(10));
+    }
+    else if (cmd == "trim") {
+        if (enableSerialOutput) printTrim();
+    }
+    else if (cmd == "trim save") {
+        motors.saveCalibration();
+        if (enableSerialOutput) Serial.println("Motor trim saved");
+    }
+    else if (cmd == "trim reset") {
+        motors.resetCalibration();
+        if (enableSerialOutput) Serial.println("Motor trim reset, trim save to keep it");
+    }
+    else if (cmd.startsWith("trim l ") || cmd.startsWith("trim r ")) {
+        setTrim(cmd.charAt(5) == 'l' ? WHEEL_LEFT : WHEEL_RIGHT, cmd.substring(7));
+    }
+    else if (cmd.startsWith("batt ")) {
+        int voltage = cmd.substring(5).toInt();
+        motors.setNominalVoltage(voltage);
+        if (enableSerialOutput) Serial.println("Nominal battery voltage set to: " + String(voltage) + " mV");
+    }
+    else if (cmd == "cur") {
+        if (enableSerialOutput) Serial.println("Motor current: " + String(motors.getCurrent()) + " mA, stalls " + String(motors.getStallCount()));
+    }
+    else if (cmd.startsWith("cur limit ")) {
+        setStallLimits(cmd.substring(10));
+    }
+    else if (cmd.startsWith("drv ")) {
+        driveWheels(cmd.substring(4));
+    }
+    else if (cmd.startsWith("arc ")) {
+        driveArc(cmd.substring(4));
+    }
     // Obstacle avoidance commands
     else if (cmd == "oa on") {
         oa.enable();
@@ -93,22 +377,58 @@ void executeCommand(String cmd) {
         if (enableSerialOutput) Serial.println("Obstacle avoidance disabled");
     }
     else if (cmd == "oa nav") {
-        oa.enable();
+        oa.startNavigation();
         if (enableSerialOutput) Serial.println("Starting autonomous navigation");
-        while (oa.isActive()) {
-            oa.navigate();
-            if (Serial.available() > 0) {
-                String stopCmd = Serial.readStringUntil('\n');
-                stopCmd.trim(); // Ensure stopCmd is trimmed
-                if (stopCmd == "st") break;
-            }
-        }
-        motors.stop();
-        if (enableSerialOutput) Serial.println("Navigation stopped");
+    }
+    else if (cmd == "oa ttc") {
+        oa.setMode(AVOID_TTC);
+        if (enableSerialOutput) Serial.println("Avoidance mode: time-to-collision");
+    }
+    else if (cmd == "oa fixed") {
+        oa.setMode(AVOID_FIXED);
+        if (enableSerialOutput) Serial.println("Avoidance mode: fixed distances");
+    }
+    else if (cmd.startsWith("oa dist ")) {
+        setAvoidanceDistances(cmd.substring(8));
+    }
+    else if (cmd == "oa stat") {
+        if (enableSerialOutput) printEscapeStats();
+    }
+    else if (cmd == "oa stat clear") {
+        oa.clearStats();
+        if (enableSerialOutput) Serial.println("Escape statistics cleared");
     }
     else if (cmd == "dist") {
         float distance = sensor.getFilteredDistance(5);
-        if (enableSerialOutput) Serial.println("Distance: " + String(distance) + " cm");
+        if (enableSerialOutput) {
+            if (sensor.isValid()) {
+                Serial.println("Distance: " + String(distance) + " cm");
+            } else {
+                Serial.println("Distance: " + String(UltrasonicSensor::statusName(sensor.getReading().status)));
+            }
+        }
+    }
+    else if (cmd == "sonar") {
+        if (enableSerialOutput) {
+            String rate = useSideSensors ? ", Rate: " + String(sonar.getUpdateRate()) + " Hz" : "";
+            Serial.println("Front: " + sonarReading(sensor, true) + ", Left: " + sonarReading(leftSensor, useSideSensors) +
+                           ", Right: " + sonarReading(rightSensor, useSideSensors) + rate);
+        }
+    }
+    else if (cmd.startsWith("temp ")) {
+        int celsius = cmd.substring(5).toInt();
+        sensor.setTemperature(celsius);
+        leftSensor.setTemperature(celsius);
+        rightSensor.setTemperature(celsius);
+        if (enableSerialOutput) Serial.println("Temperature set to: " + String(celsius) + " C");
+    }
+    else if (cmd == "lat") {
+        if (enableSerialOutput) {
+            Serial.println("Command latency: " + String(lastCommandLatency) + " us (max " + String(maxCommandLatency) +
+                           " us), max loop time: " + String(maxLoopTime) + " us");
+        }
+        maxCommandLatency = 0;
+        maxLoopTime = 0;
     }
     else if (cmd == "help") {
         if (enableCommandFeedback && enableSerialOutput) printCommands();
@@ -120,6 +440,215 @@ void executeCommand(String cmd) {
     }
 }
 
+void printWheelTelemetry() {
+    const char* names[2] = {"Left", "Right"};
+    for (int i = 0; i < 2; i++) {
+        WheelTelemetry wheel = motors.getTelemetry((Wheel)i);
+        Serial.println(String(names[i]) + ": target " + String(wheel.setpoint) + ", measured " + String(wheel.measured) +
+                       " ticks/s, error " + String(wheel.setpoint - wheel.measured) + " (peak " +
+                       String(wheel.peakError) + "), pwm " + String(wheel.pwm));
+    }
+}
+
+// Parses "<mm/s at full PWM> <dead band>"
+void setPwmModel(String args) {
+    int space = args.indexOf(' ');
+    if (space < 0) {
+        if (enableCommandFeedback && enableSerialOutput) {
+            Serial.println("Usage: pose model <mm/s> <deadband>");
+        }
+        return;
+    }
+    int speed = args.substring(0, space).toInt();
+    int deadband = args.substring(space + 1).toInt();
+    motors.setPwmModel(speed, deadband);
+    if (enableSerialOutput) {
+        Serial.println("Wheel model set to: " + String(speed) + " mm/s, dead band " + String(deadband));
+    }
+}
+
+// Parses "<offset> <gain %> <dead band>" for one motor
+void setTrim(Wheel wheel, String args) {
+    int first = args.indexOf(' ');
+    int second = args.indexOf(' ', first + 1);
+    if (first < 0 || second < 0) {
+        if (enableCommandFeedback && enableSerialOutput) {
+            Serial.println("Usage: trim <l|r> <offset> <gain %> <deadband>");
+        }
+        return;
+    }
+    int offset = args.substring(0, first).toInt();
+    int gain = args.substring(first + 1, second).toInt();
+    int deadband = args.substring(second + 1).toInt();
+    motors.setTrim(wheel, constrain(offset, -100, 100), constrain(gain, 0, 200) * 256L / 100, constrain(deadband, 0, 254));
+    if (enableSerialOutput) {
+        Serial.println("Trim set to: offset " + String(offset) + ", gain " + String(gain) + "%, dead band " + String(deadband));
+    }
+}
+
+void printTrim() {
+    const char* names[2] = {"Left", "Right"};
+    for (int i = 0; i < 2; i++) {
+        MotorTrim trim = motors.getTrim((Wheel)i);
+        Serial.println(String(names[i]) + ": offset " + String(trim.offset) + ", gain " +
+                       String((trim.gain * 100L + 128) / 256) + "%, dead band " + String(trim.deadband));
+    }
+    Serial.println("Battery: " + String(motors.getBatteryVoltage()) + " mV, nominal " +
+                   String(motors.getNominalVoltage()) + " mV");
+}
+
+// Parses "<stall mA> <stall ms> <peak mA>"
+void setStallLimits(String args) {
+    int first = args.indexOf(' ');
+    int second = args.indexOf(' ', first + 1);
+    if (first < 0 || second < 0) {
+        if (enableCommandFeedback && enableSerialOutput) {
+            Serial.println("Usage: cur limit <stall mA> <ms> <peak mA>");
+        }
+        return;
+    }
+    int stallCurrent = args.substring(0, first).toInt();
+    int stallTime = args.substring(first + 1, second).toInt();
+    int peakCurrent = args.substring(second + 1).toInt();
+    motors.setStallLimits(stallCurrent, stallTime, peakCurrent);
+    if (enableSerialOutput) {
+        Serial.println("Stall limits set to: " + String(stallCurrent) + " mA for " + String(stallTime) +
+                       " ms, peak " + String(peakCurrent) + " mA");
+    }
+}
+
+// Parses "<feedforward> <kp> <ki>", each in 1/256 PWM units
+void setSpeedGains(String args) {
+    int first = args.indexOf(' ');
+    int second = args.indexOf(' ', first + 1);
+    if (first < 0 || second < 0) {
+        if (enableCommandFeedback && enableSerialOutput) {
+            Serial.println("Usage: enc gains <feedforward> <kp> <ki>");
+        }
+        return;
+    }
+    int feedForward = args.substring(0, first).toInt();
+    int kp = args.substring(first + 1, second).toInt();
+    int ki = args.substring(second + 1).toInt();
+    motors.setSpeedGains(feedForward, kp, ki);
+    if (enableSerialOutput) {
+        Serial.println("Speed gains set to: " + String(feedForward) + "/" + String(kp) + "/" + String(ki));
+    }
+}
+
+// Parses "<left> <right>" signed PWM
+void driveWheels(String args) {
+    int space = args.indexOf(' ');
+    if (space < 0) {
+        if (enableCommandFeedback && enableSerialOutput) {
+            Serial.println("Usage: drv <left> <right>");
+        }
+        return;
+    }
+    int left = args.substring(0, space).toInt();
+    int right = args.substring(space + 1).toInt();
+    motors.setWheelSpeeds(left, right);
+    if (enableSerialOutput) {
+        Serial.println("Wheels: " + String(left) + "/" + String(right));
+    }
+}
+
+// Parses "<speed> <radius>", radius in mm, positive to the left
+void driveArc(String args) {
+    int space = args.indexOf(' ');
+    if (space < 0) {
+        if (enableCommandFeedback && enableSerialOutput) {
+            Serial.println("Usage: arc <speed> <radius mm>");
+        }
+        return;
+    }
+    int speed = args.substring(0, space).toInt();
+    int radius = args.substring(space + 1).toInt();
+    motors.arc(speed, radius);
+    if (enableSerialOutput) {
+        Serial.println("Arc: speed " + String(speed) + ", radius " + String(radius) + " mm");
+    }
+}
+
+// Parses "<accel> <decel>" in PWM counts per second
+void setMotorRamp(String args) {
+    int space = args.indexOf(' ');
+    if (space < 0) {
+        if (enableCommandFeedback && enableSerialOutput) {
+            Serial.println("Usage: ramp <accel> <decel>");
+        }
+        return;
+    }
+    unsigned int accel = args.substring(0, space).toInt();
+    unsigned int decel = args.substring(space + 1).toInt();
+    motors.setRamp(accel, decel);
+    if (enableSerialOutput) {
+        Serial.println("Ramp set to: " + String(accel) + "/" + String(decel) + " per s");
+    }
+}
+
+// Parses "<stop> <turn> <critical>" in cm
+void setAvoidanceDistances(String args) {
+    int first = args.indexOf(' ');
+    int second = args.indexOf(' ', first + 1);
+    if (first < 0 || second < 0) {
+        if (enableCommandFeedback && enableSerialOutput) {
+            Serial.println("Usage: oa dist <stop> <turn> <critical>");
+        }
+        return;
+    }
+    int stopCm = args.substring(0, first).toInt();
+    int turnCm = args.substring(first + 1, second).toInt();
+    int criticalCm = args.substring(second + 1).toInt();
+    oa.setDistances(stopCm * 10, turnCm * 10, criticalCm * 10);
+    if (enableSerialOutput) {
+        Serial.println("Distances set to: " + String(stopCm) + "/" + String(turnCm) + "/" + String(criticalCm) + " cm");
+    }
+}
+
+// Drives at a wall ahead at several speeds, avoidance must stay out of it
+void startCalibration(StopMode mode) {
+    if (oa.isNavigating()) {
+        oa.stopNavigation();
+    }
+    oa.disable();
+    calibration.start(mode);
+    calibrationReportPending = true;
+    if (enableSerialOutput) Serial.println("Calibrating stopping distance, avoidance disabled");
+}
+
+void finishCalibration() {
+    if (calibration.getState() != CAL_DONE) {
+        if (enableSerialOutput) Serial.println("Calibration stopped, no wall in range or robot stuck");
+        return;
+    }
+    uint16_t stopping = calibration.getStoppingDistanceAt(motors.getSpeed());
+    oa.setStoppingDistance(stopping);
+    if (!enableSerialOutput) return;
+
+    Serial.println("\nStopping distance:");
+    for (int i = 0; i < calibration.getRunCount(); i++) {
+        Serial.print("  speed "); Serial.print(calibration.getRunSpeed(i));
+        Serial.print(": "); Serial.print(calibration.getStoppingDistance(i)); Serial.println(" mm");
+    }
+    Serial.println("Avoidance distances derived for speed " + String(motors.getSpeed()) + " (" + String(stopping) +
+                   " mm to stop), oa on to re-enable");
+}
+
+void printEscapeStats() {
+    Serial.println("Escapes: level " + String(oa.getEscalation()) + ", " + String(oa.getEpisodeCount()) +
+                   " cleared, time to clear " + String(oa.getLastTimeToClear()) + " ms (max " +
+                   String(oa.getMaxTimeToClear()) + " ms)");
+    unsigned long now = millis();
+    for (int i = 0; i < oa.getHistoryCount(); i++) {
+        EscapeRecord record = oa.getHistory(i);
+        Serial.print("  -"); Serial.print(now - record.time); Serial.print(" ms: ");
+        Serial.print(record.rotatedLeft ? "left" : "right");
+        Serial.print(", level "); Serial.print(record.level);
+        Serial.println(record.cleared ? ", cleared" : "");
+    }
+}
+
 void printCommands() {
     Serial.println("\nAvailable commands:");
     Serial.println("Movement commands:");
@@ -129,13 +658,38 @@ void printCommands() {
     Serial.println("  rt  - Turn right");
     Serial.println("  rl  - Rotate left");
     Serial.println("  rr  - Rotate right");
-    Serial.println("  st  - Stop motors");
+    Serial.println("  st  - Stop motors (st brake / st coast to stop at once)");
+    Serial.println("  brake <ms> - How long st brake shorts the motors before coasting");
+    Serial.println("  cal brake / cal coast - Measure stopping distance against a wall ahead");
+    Serial.println("  mv 30cm / bk 500ms / rl 90deg - Move by distance, time or angle, then stop and report");
+    Serial.println("  drv <left> <right> - Signed PWM per wheel (-255 to 255)");
+    Serial.println("  arc <speed> <mm> - Drive an arc of that radius, positive left, 0 spins");
     Serial.println("\nSpeed control:");
     Serial.println("  spd <0-255> - Set motor speed");
+    Serial.println("  ramp <accel> <decel> - Motor slew limits per second, 0 for none");
+    Serial.println("  pose    - Dead-reckoned position and heading (pose reset to zero)");
+    Serial.println("  pose track <mm> - Distance between the wheels");
+    Serial.println("  pose model <mm/s> <deadband> - Wheel speed at full PWM without encoders");
+    Serial.println("  enc on/off - Encoder speed loop, speeds in ticks/s when on");
+    Serial.println("  enc     - Wheel speed targets, measurements and tracking error");
+    Serial.println("  enc gains <ff> <kp> <ki> - Speed loop gains in 1/256 PWM");
+    Serial.println("  trim    - Show motor trim and battery voltage");
+    Serial.println("  trim <l|r> <offset> <gain %> <deadband> - Trim one motor");
+    Serial.println("  trim save / trim reset - Keep the trim in EEPROM / restore defaults");
+    Serial.println("  batt <mV> - Battery voltage the trim was set at, 0 for no compensation");
+    Serial.println("  cur     - Show motor current and stall count");
+    Serial.println("  cur limit <stall mA> <ms> <peak mA> - Stall detection limits");
     Serial.println("\nObstacle avoidance:");
     Serial.println("  oa on   - Enable obstacle avoidance");
     Serial.println("  oa off  - Disable obstacle avoidance");
-    Serial.println("  oa nav  - Start autonomous navigation");
+    Serial.println("  oa nav  - Start autonomous navigation (st to stop)");
+    Serial.println("  oa dist <stop> <turn> <critical> - Set avoidance distances in cm");
+    Serial.println("  oa ttc  - Speed-scaled, time-to-collision avoidance");
+    Serial.println("  oa fixed - Fixed distance avoidance (default)");
+    Serial.println("  oa stat - Escape history and time to clear (oa stat clear resets)");
     Serial.println("  dist    - Read distance sensor");
+    Serial.println("  sonar   - Read front/left/right sensors and update rate");
+    Serial.println("  temp <C> - Set air temperature for distance compensation");
+    Serial.println("  lat     - Show command latency and loop time");
     Serial.println("  help    - Show this help message");
 }
@@ -0,0 +1,24 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+// Counts failed checks; main() returns checkResult()
+static int checkFailures = 0;
+
+#define CHECK(condition, ...) \
+    do { \
+        if (!(condition)) { \
+            checkFailures++; \
+            printf("%s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } while (0)
+
+static int checkResult(const char* name) {
+    printf("%s: %s\n", name, checkFailures == 0 ? "ok" : "FAILED");
+    return checkFailures == 0 ? 0 : 1;
+}
+
+#endif
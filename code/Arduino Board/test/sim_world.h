@@ -0,0 +1,142 @@
+// A differential drive robot among walls, for the avoidance tests. The
+// motors drive the wheels through a first order lag, and the front
+// ultrasonic sensor on pin 2 (INT0) gets its echo edges at the exact
+// times the ranged distance implies
+#ifndef SIM_WORLD_H
+#define SIM_WORLD_H
+
+#include <Arduino.h>
+#include <vector>
+#include "MotorController.h"
+#include "UltrasonicSensor.h"
+
+struct Wall {
+    double x1, y1, x2, y2; // mm
+};
+
+class SimWorld {
+  private:
+    MotorController* motors;
+    UltrasonicSensor* sensor;
+    bool wasBusy;
+    uint32_t riseTime, fallTime; // us, 0 when no edge is due
+    uint32_t lastLoop;
+
+    static const int ECHO_PIN = 2;
+    static const uint32_t BURST_TIME = 450; // us, trigger to echo start
+
+    // Signed PWM to wheel speed, settling with the motor's time constant
+    double settle(double speed, int output, double dt) {
+        double target = output / 255.0 * maxSpeed;
+        double tau = output != 0 ? 0.10 : (motors->isBraking() ? 0.025 : 0.30);
+        return speed + (target - speed) * (1 - exp(-dt / tau));
+    }
+
+    void fireEdges(uint32_t until) {
+        while (true) {
+            uint32_t next = riseTime != 0 ? riseTime : fallTime;
+            if (next == 0 || next > until) return;
+            simTime = next;
+            setPin(ECHO_PIN, riseTime != 0 ? HIGH : LOW);
+            if (riseTime != 0) riseTime = 0;
+            else fallTime = 0;
+            fireInterrupt(0);
+        }
+    }
+
+    void schedulePing() {
+        bool busy = sensor->isBusy();
+        if (busy && !wasBusy) {
+            double range = rangeAhead();
+            if (range < 4500) {
+                riseTime = simTime + BURST_TIME;
+                fallTime = riseTime + (uint32_t)(range * 2 / 0.343);
+            }
+        }
+        wasBusy = busy;
+    }
+
+  public:
+    double x, y, heading;          // mm, radians
+    double leftSpeed, rightSpeed;  // mm/s
+    double maxSpeed;               // mm/s at full PWM
+    double track;                  // mm between the wheels
+    double travelled;              // mm along the path
+    std::vector<Wall> walls;
+
+    SimWorld(MotorController* m, UltrasonicSensor* s) {
+        motors = m;
+        sensor = s;
+        wasBusy = false;
+        riseTime = 0;
+        fallTime = 0;
+        lastLoop = simTime;
+        x = 0;
+        y = 0;
+        heading = 0;
+        leftSpeed = 0;
+        rightSpeed = 0;
+        maxSpeed = 1000;
+        track = 130;
+        travelled = 0;
+    }
+
+    void addWall(double x1, double y1, double x2, double y2) {
+        walls.push_back({x1, y1, x2, y2});
+    }
+
+    // Distance along the heading to the nearest wall, huge if none
+    double rangeAhead() {
+        double dx = cos(heading), dy = sin(heading);
+        double best = 1e9;
+        for (const Wall& w : walls) {
+            double ex = w.x2 - w.x1, ey = w.y2 - w.y1;
+            double denominator = dx * ey - dy * ex;
+            if (fabs(denominator) < 1e-9) continue;
+            double t = ((w.x1 - x) * ey - (w.y1 - y) * ex) / denominator;
+            double u = ((w.x1 - x) * dy - (w.y1 - y) * dx) / denominator;
+            if (t > 0 && u >= 0 && u <= 1) best = min(best, t);
+        }
+        return best;
+    }
+
+    // Shortest distance from the robot's centre to any wall
+    double clearance() {
+        double best = 1e9;
+        for (const Wall& w : walls) {
+            double ex = w.x2 - w.x1, ey = w.y2 - w.y1;
+            double t = ((x - w.x1) * ex + (y - w.y1) * ey) / (ex * ex + ey * ey);
+            t = constrain(t, 0.0, 1.0);
+            best = min(best, hypot(x - (w.x1 + t * ex), y - (w.y1 + t * ey)));
+        }
+        return best;
+    }
+
+    // Advances by one 1ms step: echo edges, wheel motion, then whatever
+    // the test runs each loop() pass
+    template <class Loop>
+    void step(Loop loop) {
+        uint32_t next = lastLoop + 1000;
+        fireEdges(next);
+        simTime = next;
+        lastLoop = next;
+
+        double dt = 0.001;
+        leftSpeed = settle(leftSpeed, motors->getLeftOutput(), dt);
+        rightSpeed = settle(rightSpeed, motors->getRightOutput(), dt);
+        double forward = (leftSpeed + rightSpeed) / 2 * dt;
+        heading += (rightSpeed - leftSpeed) / track * dt;
+        x += forward * cos(heading);
+        y += forward * sin(heading);
+        travelled += fabs(forward);
+
+        loop();
+        schedulePing();
+    }
+
+    double speed() {
+        return (leftSpeed + rightSpeed) / 2;
+    }
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include <Arduino.h>
+#include <EEPROM.h>
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+
+uint32_t simTime = 0;
+int analogValue[22];
+int pwmValue[22];
+uint32_t pulseInResult = 0;
+
+volatile uint8_t SREG, PCICR, PCIFR, PCMSK0, PCMSK1, PCMSK2;
+volatile uint8_t TCCR2A, TCCR2B, OCR2A, TIMSK2, TCNT2, TIFR2;
+
+// Input and output registers per port, indexed like digitalPinToPort()
+static volatile uint8_t inputs[5];
+static volatile uint8_t outputs[5];
+static void (*handlers[2])(void);
+
+void setPin(uint8_t pin, uint8_t level) {
+    volatile uint8_t* input = &inputs[digitalPinToPort(pin)];
+    if (level) *input |= digitalPinToBitMask(pin);
+    else *input &= ~digitalPinToBitMask(pin);
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    volatile uint8_t* output = &outputs[digitalPinToPort(pin)];
+    if (value) *output |= digitalPinToBitMask(pin);
+    else *output &= ~digitalPinToBitMask(pin);
+}
+
+int digitalRead(uint8_t pin) {
+    return (inputs[digitalPinToPort(pin)] & digitalPinToBitMask(pin)) ? HIGH : LOW;
+}
+
+void analogWrite(uint8_t pin, int value) { pwmValue[pin] = value; }
+int analogRead(uint8_t pin) { return analogValue[pin]; }
+uint32_t millis() { return simTime / 1000; }
+uint32_t micros() { return simTime; }
+void delay(uint32_t ms) { simTime += ms * 1000; }
+void delayMicroseconds(unsigned int us) { simTime += us; }
+
+uint32_t pulseIn(uint8_t, uint8_t, uint32_t timeout) {
+    uint32_t waited = min(pulseInResult == 0 ? timeout : pulseInResult, timeout);
+    simTime += waited;
+    return pulseInResult > timeout ? 0 : pulseInResult;
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int) { handlers[interrupt] = handler; }
+void detachInterrupt(uint8_t interrupt) { handlers[interrupt] = nullptr; }
+void fireInterrupt(uint8_t interrupt) {
+    if (handlers[interrupt] != nullptr) handlers[interrupt]();
+}
+
+void noInterrupts() {}
+void interrupts() {}
+
+int32_t map(int32_t value, int32_t fromLow, int32_t fromHigh, int32_t toLow, int32_t toHigh) {
+    return (value - fromLow) * (toHigh - toLow) / (fromHigh - fromLow) + toLow;
+}
+
+volatile uint8_t* portInputRegister(uint8_t port) { return &inputs[port]; }
+volatile uint8_t* portOutputRegister(uint8_t port) { return &outputs[port]; }
@@ -0,0 +1,163 @@
+// Just enough of the Arduino core to run the sketch modules on a PC.
+// Time and pins are simulated: tests advance simTime and set pin levels
+// and analog readings directly
+#ifndef ARDUINO_STUB_H
+#define ARDUINO_STUB_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "avr/pgmspace.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define abs(x) ((x) > 0 ? (x) : -(x))
+#define sq(x) ((x) * (x))
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+int analogRead(uint8_t pin);
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(unsigned int us);
+uint32_t pulseIn(uint8_t pin, uint8_t state, uint32_t timeout = 1000000);
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+void noInterrupts();
+void interrupts();
+int32_t map(int32_t value, int32_t fromLow, int32_t fromHigh, int32_t toLow, int32_t toHigh);
+
+// Uno pin map: 0-7 PORTD, 8-13 PORTB, A0-A5 PORTC
+inline int digitalPinToInterrupt(uint8_t pin) { return pin == 2 ? 0 : (pin == 3 ? 1 : NOT_AN_INTERRUPT); }
+inline uint8_t digitalPinToPort(uint8_t pin) { return pin < 8 ? 4 : (pin < 14 ? 2 : 3); }
+inline uint8_t digitalPinToBitMask(uint8_t pin) { return 1 << (pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14)); }
+constexpr uint8_t digitalPinToPCICRbit(uint8_t pin) { return pin < 8 ? 2 : (pin < 14 ? 0 : 1); }
+constexpr uint8_t digitalPinToPCMSKbit(uint8_t pin) { return pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14); }
+#define digitalPinToPCICR(pin) ((pin) <= 21 ? &PCICR : (volatile uint8_t*)0)
+#define digitalPinToPCMSK(pin) (digitalPinToPCICRbit(pin) == 0 ? &PCMSK0 : (digitalPinToPCICRbit(pin) == 1 ? &PCMSK1 : &PCMSK2))
+volatile uint8_t* portInputRegister(uint8_t port);
+volatile uint8_t* portOutputRegister(uint8_t port);
+
+// Simulation state, in Arduino.cpp
+extern uint32_t simTime; // us
+extern int analogValue[22];
+extern int pwmValue[22];
+extern uint32_t pulseInResult;
+void setPin(uint8_t pin, uint8_t level);
+void fireInterrupt(uint8_t interrupt);
+
+#define F_CPU 16000000UL
+extern volatile uint8_t SREG, PCICR, PCIFR, PCMSK0, PCMSK1, PCMSK2;
+#define PCICR PCICR // A macro on the AVR, so #if defined(PCICR) works
+extern volatile uint8_t TCCR2A, TCCR2B, OCR2A, TIMSK2, TCNT2, TIFR2;
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+#define WGM21 1
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define OCIE2A 1
+#define OCF2A 1
+inline void cli() {}
+inline void sei() {}
+#define ISR(vector) extern "C" void vector()
+#define TIMER2_COMPA_vect timer2CompareA
+#define PCINT0_vect pinChange0
+#define PCINT1_vect pinChange1
+#define PCINT2_vect pinChange2
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+class String {
+  private:
+    std::string text;
+
+  public:
+    String(const char* c = "") : text(c) {}
+    String(const std::string& s) : text(s) {}
+    String(const __FlashStringHelper* c) : text((const char*)c) {}
+    String(char c) : text(1, c) {}
+    String(int v) : text(std::to_string(v)) {}
+    String(unsigned int v) : text(std::to_string(v)) {}
+    String(long v) : text(std::to_string(v)) {}
+    String(unsigned long v) : text(std::to_string(v)) {}
+    String(double v, unsigned char decimals = 2) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.*f", decimals, v);
+        text = buffer;
+    }
+    unsigned int length() const { return text.size(); }
+    char charAt(unsigned int i) const { return i < text.size() ? text[i] : 0; }
+    bool startsWith(const String& prefix) const { return text.compare(0, prefix.text.size(), prefix.text) == 0; }
+    bool endsWith(const String& suffix) const {
+        return text.size() >= suffix.text.size() &&
+               text.compare(text.size() - suffix.text.size(), suffix.text.size(), suffix.text) == 0;
+    }
+    String substring(unsigned int from) const { return from < text.size() ? String(text.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        return from < text.size() ? String(text.substr(from, to - from)) : String();
+    }
+    int32_t toInt() const { return atol(text.c_str()); }
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t found = text.find(c, from);
+        return found == std::string::npos ? -1 : (int)found;
+    }
+    void trim() {}
+    void toLowerCase() {}
+    void reserve(unsigned int) {}
+    String& operator+=(const String& other) { text += other.text; return *this; }
+    String& operator+=(char c) { text += c; return *this; }
+    bool operator==(const String& other) const { return text == other.text; }
+    bool operator==(const char* other) const { return text == other; }
+    bool operator!=(const char* other) const { return text != other; }
+    const char* c_str() const { return text.c_str(); }
+    friend String operator+(const String& a, const String& b) { return String(a.text + b.text); }
+    friend String operator+(const String& a, const char* b) { return String(a.text + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b.text); }
+};
+
+// Output is dropped; tests check state, not messages
+class HardwareSerial {
+  public:
+    void begin(uint32_t) {}
+    int available() { return 0; }
+    int read() { return -1; }
+    template <class T> void print(const T&) {}
+    template <class T> void println(const T&) {}
+    void println() {}
+};
+extern HardwareSerial Serial;
+
+#endif
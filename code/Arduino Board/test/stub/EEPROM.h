@@ -0,0 +1,19 @@
+#ifndef EEPROM_STUB_H
+#define EEPROM_STUB_H
+
+#include <Arduino.h>
+
+class EEPROMClass {
+  private:
+    uint8_t memory[1024];
+
+  public:
+    uint8_t read(int address) { return memory[address]; }
+    void write(int address, uint8_t value) { memory[address] = value; }
+    void update(int address, uint8_t value) { memory[address] = value; }
+    template <class T> T& get(int address, T& value) { memcpy(&value, memory + address, sizeof(T)); return value; }
+    template <class T> const T& put(int address, const T& value) { memcpy(memory + address, &value, sizeof(T)); return value; }
+};
+extern EEPROMClass EEPROM;
+
+#endif
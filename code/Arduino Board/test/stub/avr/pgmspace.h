@@ -0,0 +1,8 @@
+#ifndef PGMSPACE_STUB_H
+#define PGMSPACE_STUB_H
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+
+#endif
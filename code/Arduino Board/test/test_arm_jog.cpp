@@ -0,0 +1,93 @@
+// Cartesian jogs through the whole arm: RobotArm queues the moves,
+// the Timer 2 ISR paces them, and the jogs must trace straight lines
+#include <Arduino.h>
+#include "RobotArm.h"
+#include "check.h"
+
+extern "C" void TIMER2_COMPA_vect();
+
+// Runs the servo timer and the arm for ms of simulated time
+static void run(RobotArm& arm, long ms) {
+    uint32_t end = simTime + ms * 1000;
+    while (simTime < end) {
+        simTime += (OCR2A + 1) * 2; // 2us timer ticks
+        TIMER2_COMPA_vect();
+        arm.update();
+    }
+}
+
+// Every point of a box in front of the arm that the kinematics accept
+// must come back through the whole-degree servo angles within rounding
+static void checkWorkspace() {
+    ArmKinematics kinematics(60, 80, 80);
+    int solved = 0;
+    for (int x = 20; x <= 150; x += 5) {
+        for (int y = -100; y <= 100; y += 5) {
+            for (int z = 0; z <= 180; z += 5) {
+                int angles[3];
+                if (kinematics.inverse({x, y, z}, angles) != REACH_OK) continue;
+                solved++;
+                ArmPoint reached = kinematics.forward(angles[0], angles[1], angles[2]);
+                CHECK(abs(reached.x - x) <= 3 && abs(reached.y - y) <= 3 && abs(reached.z - z) <= 3,
+                      "%d %d %d reached as %d %d %d", x, y, z, reached.x, reached.y, reached.z);
+            }
+        }
+    }
+    CHECK(solved > 5000, "only %d workspace points solved", solved);
+}
+
+// Jogs steps times along one axis, back to back, then checks every
+// point the arm passed through a whole step later
+static void checkLine(RobotArm& arm, ArmPoint start, char axis, char direction, int steps) {
+    CHECK(arm.moveTo(start), "start %d %d %d out of reach", start.x, start.y, start.z);
+    run(arm, 2000);
+    ArmPoint from = arm.getPosition();
+    int sign = direction == '+' ? 1 : -1;
+
+    for (int i = 1; i <= steps; i++) {
+        CHECK(arm.jog(axis, direction), "jog %c%c %d refused", axis, direction, i);
+        run(arm, 1000);
+        ArmPoint at = arm.getPosition();
+        int along = axis == 'x' ? at.x - from.x : (axis == 'y' ? at.y - from.y : at.z - from.z);
+        int offX = axis == 'x' ? 0 : at.x - from.x;
+        int offY = axis == 'y' ? 0 : at.y - from.y;
+        int offZ = axis == 'z' ? 0 : at.z - from.z;
+        CHECK(abs(along - sign * i * arm.getJogStep()) <= 3 && abs(offX) <= 3 && abs(offY) <= 3 && abs(offZ) <= 3,
+              "%c%c jog %d from %d %d %d reached %d %d %d", axis, direction, i, from.x, from.y, from.z,
+              at.x, at.y, at.z);
+    }
+}
+
+static void checkJogs() {
+    RobotArm arm(13, 7, 8, 11);
+    arm.begin();
+    run(arm, 2000);
+
+    arm.setJogStep(10);
+    checkLine(arm, {70, 0, 120}, 'x', '+', 6);
+    checkLine(arm, {130, 0, 100}, 'x', '-', 6);
+    checkLine(arm, {100, -50, 100}, 'y', '+', 10);
+    checkLine(arm, {90, 40, 90}, 'y', '-', 8);
+    checkLine(arm, {100, 20, 40}, 'z', '+', 8);
+    checkLine(arm, {100, -20, 150}, 'z', '-', 8);
+
+    // Small steps must not drift either
+    arm.setJogStep(2);
+    checkLine(arm, {100, 0, 100}, 'y', '+', 20);
+
+    // The stretched-out arm refuses to jog further and stays put
+    CHECK(arm.moveTo({150, 0, 60}), "stretched start out of reach");
+    run(arm, 2000);
+    arm.setJogStep(20);
+    ArmPoint before = arm.getPosition();
+    CHECK(!arm.jog('x', '+'), "jog past full reach accepted");
+    run(arm, 1000);
+    ArmPoint after = arm.getPosition();
+    CHECK(before.x == after.x && before.y == after.y && before.z == after.z, "refused jog moved the arm");
+}
+
+int main() {
+    checkWorkspace();
+    checkJogs();
+    return checkResult("arm jog");
+}
@@ -0,0 +1,110 @@
+// Inverse trig and arm kinematics against double precision references,
+// with the module's long narrowed to 32 bits as on the AVR
+#include <Arduino.h>
+#include "FixedTrig.h"
+#include "ArmKinematics.h"
+#include "check.h"
+
+static double centidegrees(double radians) {
+    return radians * 18000.0 / M_PI;
+}
+
+static void checkInverseTrig() {
+    // Small arguments, and the Q14-scaled lengths the kinematics pass in
+    const long scales[] = {1, 1000, 1L << 20, 8000000};
+    for (long scale : scales) {
+        for (int step = 0; step < 720; step++) {
+            double angle = step * M_PI / 360.0;
+            long x = lround(cos(angle) * scale);
+            long y = lround(sin(angle) * scale);
+            if (x == 0 && y == 0) continue;
+            double error = fabs(fixedAtan2(y, x) - centidegrees(atan2(y, x)));
+            if (error > 18000) error = 36000 - error;
+            CHECK(error <= 3, "atan2(%ld, %ld) off by %.1f centidegrees", y, x, error);
+        }
+    }
+
+    for (long cosine = -16384; cosine <= 16384; cosine += 7) {
+        double error = fabs(fixedAcos(cosine) - centidegrees(acos(cosine / 16384.0)));
+        CHECK(error <= 3, "acos(%ld) off by %.1f centidegrees", cosine, error);
+    }
+
+    const uint32_t squares[] = {0, 1, 2, 99, 100, 268435456UL, 4294967295UL};
+    for (uint32_t value : squares) {
+        uint32_t root = fixedSqrt(value);
+        CHECK((uint64_t)root * root <= value && (uint64_t)(root + 1) * (root + 1) > value,
+              "sqrt(%u) gave %u", (unsigned)value, (unsigned)root);
+    }
+}
+
+static void checkForward() {
+    ArmKinematics arm(60, 80, 80);
+    ArmPoint home = arm.forward(90, 90, 90);
+    CHECK(home.x == 80 && home.y == 0 && home.z == 140, "home at %d %d %d", home.x, home.y, home.z);
+
+    // Against the same geometry in double precision
+    for (int base = 0; base <= 180; base += 10) {
+        for (int shoulder = 0; shoulder <= 180; shoulder += 10) {
+            for (int elbow = 0; elbow <= 180; elbow += 10) {
+                double yaw = (base - 90) * M_PI / 180;
+                double upper = shoulder * M_PI / 180;
+                double fore = (shoulder + elbow - 180) * M_PI / 180;
+                double reach = 80 * cos(upper) + 80 * cos(fore);
+                ArmPoint point = arm.forward(base, shoulder, elbow);
+                CHECK(fabs(point.x - reach * cos(yaw)) <= 1 && fabs(point.y - reach * sin(yaw)) <= 1 &&
+                      fabs(point.z - (60 + 80 * sin(upper) + 80 * sin(fore))) <= 1,
+                      "forward(%d, %d, %d) gave %d %d %d", base, shoulder, elbow, point.x, point.y, point.z);
+            }
+        }
+    }
+}
+
+// Every pose on a grid is taken to its point and solved back. Where the
+// solver finds angles they must be the pose itself, or reach the same
+// point within servo rounding
+static void checkRoundTrip() {
+    ArmKinematics arm(60, 80, 80);
+    int solved = 0;
+    for (int base = 0; base <= 180; base += 5) {
+        for (int shoulder = 0; shoulder <= 180; shoulder += 5) {
+            for (int elbow = 5; elbow <= 180; elbow += 5) {
+                ArmPoint target = arm.forward(base, shoulder, elbow);
+                int angles[3];
+                ReachStatus status = arm.inverse(target, angles);
+                if (status != REACH_OK) continue;
+                solved++;
+                ArmPoint reached = arm.forward(angles[0], angles[1], angles[2]);
+                int error = abs(reached.x - target.x) + abs(reached.y - target.y) + abs(reached.z - target.z);
+                CHECK(error <= 8, "%d %d %d solved to %d %d %d, %d mm away", base, shoulder, elbow,
+                      angles[0], angles[1], angles[2], error);
+            }
+        }
+    }
+    CHECK(solved > 30000, "only %d poses solved", solved);
+
+    const int poses[][3] = {{90, 90, 90}, {90, 45, 90}, {90, 60, 120}, {90, 120, 90}, {45, 80, 100}, {135, 30, 120}};
+    for (const int* pose : poses) {
+        int angles[3];
+        ReachStatus status = arm.inverse(arm.forward(pose[0], pose[1], pose[2]), angles);
+        CHECK(status == REACH_OK && abs(angles[0] - pose[0]) <= 1 && abs(angles[1] - pose[1]) <= 1 &&
+              abs(angles[2] - pose[2]) <= 1, "%d %d %d solved to %d %d %d", pose[0], pose[1], pose[2],
+              angles[0], angles[1], angles[2]);
+    }
+}
+
+static void checkReachLimits() {
+    ArmKinematics arm(60, 80, 80);
+    int angles[3];
+    CHECK(arm.inverse({500, 0, 0}, angles) == REACH_TOO_FAR, "500 0 0 should be too far");
+    CHECK(arm.inverse({32767, 32767, -32768}, angles) == REACH_TOO_FAR, "far corner should be too far");
+    CHECK(arm.inverse({0, 0, 60}, angles) == REACH_TOO_CLOSE, "shoulder axis should be too close");
+    CHECK(arm.inverse({-100, 0, 100}, angles) == REACH_JOINT_LIMIT, "behind the base should be a joint limit");
+}
+
+int main() {
+    checkInverseTrig();
+    checkForward();
+    checkRoundTrip();
+    checkReachLimits();
+    return checkResult("arm kinematics");
+}
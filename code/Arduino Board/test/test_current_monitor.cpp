@@ -0,0 +1,124 @@
+// Stall and overcurrent detection on motor current traces sampled every
+// 10ms, first through CurrentMonitor alone, then through MotorController
+// reading them off the shunt's ADC pin
+#include <Arduino.h>
+#include <vector>
+#include "CurrentMonitor.h"
+#include "MotorController.h"
+#include "check.h"
+
+static const uint16_t RUNNING = 600; // mA, free running on the floor
+static const uint16_t STALLED = 2200;
+
+// Current drawn at each 10ms sample of a trace
+typedef std::vector<uint16_t> Trace;
+
+static Trace startUp() {
+    // Inrush over the peak limit for two samples, then settling
+    Trace trace = {3200, 3100, 2400, 1800, 1300, 1000, 800, 700};
+    trace.resize(60, RUNNING);
+    return trace;
+}
+
+// Samples until the monitor trips, -1 if it never does
+static int tripAt(CurrentMonitor& monitor, const Trace& trace) {
+    for (size_t i = 0; i < trace.size(); i++) {
+        if (monitor.addSample(trace[i])) return i;
+    }
+    return -1;
+}
+
+static void checkNoFalseTrips() {
+    CurrentMonitor monitor;
+    CHECK(tripAt(monitor, startUp()) == -1, "start-up inrush tripped");
+
+    // Brush commutation: single samples far over the peak limit
+    Trace running;
+    for (int i = 0; i < 500; i++) running.push_back(i % 7 == 3 ? 3500 : RUNNING + (i % 5) * 40);
+    CHECK(tripAt(monitor, running) == -1, "commutation spikes tripped");
+
+    // Climbing a cable: 100ms at 1800mA pulls the average under the limit
+    Trace bump(20, RUNNING);
+    bump.resize(30, 1800);
+    bump.resize(60, RUNNING);
+    CHECK(tripAt(monitor, bump) == -1, "a brief load tripped");
+}
+
+static void checkStall() {
+    CurrentMonitor monitor;
+    Trace trace = startUp();
+    size_t onset = trace.size();
+    // The wheels stop against a low obstacle and the current climbs
+    trace.insert(trace.end(), {1100, 1600, 2000});
+    trace.resize(onset + 100, STALLED);
+    int trip = tripAt(monitor, trace);
+    // The 16 sample average reaches 1500mA some 8 samples in, and must
+    // then hold over it for the default 10 samples
+    CHECK(trip > (int)onset + 10, "stall tripped %d ms after onset, before the average settled",
+          (trip - (int)onset) * 10);
+    CHECK(trip != -1 && trip <= (int)onset + 25, "stall not caught in 250ms (tripped at %d)", trip);
+
+    // Tighter limits from setStallLimits()
+    monitor.reset();
+    monitor.setLimits(1000, 5, 3000);
+    int tightTrip = tripAt(monitor, trace);
+    CHECK(tightTrip != -1 && tightTrip < trip, "tighter limits tripped at %d, default at %d", tightTrip, trip);
+}
+
+static void checkOvercurrent() {
+    CurrentMonitor monitor;
+    Trace trace = startUp();
+    size_t onset = trace.size();
+    trace.resize(onset + 20, 5000); // Shorted winding
+    CHECK(tripAt(monitor, trace) == (int)onset + 2, "short tripped at %d, not 3 samples in", tripAt(monitor, trace));
+}
+
+// The same stall read through the ADC while MotorController drives
+static void checkMotorBackOff() {
+    const uint8_t CURRENT_PIN = A7; // Where code.ino wires it on a Nano
+    const uint16_t FULL_SCALE = 10000; // mA at 1023
+    MotorController motors(3, 4, 5, 6, 9, 10);
+    motors.begin();
+    motors.attachCurrentSense(CURRENT_PIN, FULL_SCALE);
+    motors.setSpeed(255);
+    motors.moveForward();
+
+    Trace trace = startUp();
+    trace.resize(trace.size() + 60, STALLED);
+    uint8_t stalls = motors.getStallCount();
+    long stalledAt = -1;
+    for (size_t ms = 0; ms < trace.size() * 10 && stalledAt < 0; ms++) {
+        analogValue[CURRENT_PIN] = (uint32_t)trace[ms / 10] * 1023 / FULL_SCALE;
+        simTime += 1000;
+        motors.update();
+        if (motors.getStallCount() != stalls) stalledAt = ms;
+    }
+    CHECK(stalledAt > (long)startUp().size() * 10, "stall detected during start-up at %ld ms", stalledAt);
+    CHECK(motors.getStallCount() == stalls + 1, "stall not counted once");
+    motors.update();
+    CHECK(motors.getLeftOutput() <= 0 && motors.getRightOutput() <= 0, "still driving into the stall");
+
+    // Backing away frees the wheels, then the back-off ends by itself
+    analogValue[CURRENT_PIN] = (uint32_t)RUNNING * 1023 / FULL_SCALE;
+    for (int ms = 0; ms < 1000; ms++) {
+        simTime += 1000;
+        motors.update();
+    }
+    CHECK(motors.getLeftOutput() == 0 && motors.getRightOutput() == 0, "back-off never stopped");
+
+    // Stopped motors never count as stalled, whatever the sense pin reads
+    analogValue[CURRENT_PIN] = (uint32_t)STALLED * 1023 / FULL_SCALE;
+    for (int ms = 0; ms < 1000; ms++) {
+        simTime += 1000;
+        motors.update();
+    }
+    CHECK(motors.getStallCount() == stalls + 1, "stopped motors counted as stalled");
+}
+
+int main() {
+    checkNoFalseTrips();
+    checkStall();
+    checkOvercurrent();
+    checkMotorBackOff();
+    return checkResult("current monitor");
+}
@@ -0,0 +1,250 @@
+// Obstacle avoidance driving a simulated robot: see sim_world.h
+#include <Arduino.h>
+#include "ObstacleAvoidance.h"
+#include "sim_world.h"
+#include "check.h"
+
+struct Robot {
+    MotorController motors;
+    UltrasonicSensor sensor;
+    ObstacleAvoidance oa;
+    SimWorld world;
+
+    Robot() : motors(3, 4, 5, 6, 9, 10), sensor(12, 2), oa(&motors, &sensor), world(&motors, &sensor) {
+        motors.begin();
+        sensor.begin();
+        oa.begin();
+    }
+
+    void step() {
+        world.step([this]() {
+            motors.update();
+            sensor.update();
+            oa.update();
+        });
+    }
+
+    void run(long ms) {
+        for (long i = 0; i < ms; i++) step();
+    }
+};
+
+// Something steps in front of the robot inside the critical distance.
+// The emergency stop must hold the brake for the whole brake time
+// before the escape reverses, rather than the escape's stop phase
+// letting it go early, whether shorter or longer than that phase
+static void checkCriticalBrake(bool navigating, unsigned int brakeTime) {
+    Robot robot;
+    robot.motors.setBrakeTime(brakeTime);
+    robot.motors.setSpeed(200);
+    if (navigating) {
+        robot.oa.startNavigation();
+    }
+    else {
+        robot.oa.enable();
+        robot.motors.moveForward();
+    }
+    robot.run(1000);
+    CHECK(!robot.oa.isManeuvering(), "escaping with nothing ahead");
+
+    robot.world.addWall(robot.world.x + 120, -500, robot.world.x + 120, 500);
+    long braked = 0;
+    for (long ms = 0; ms < 500 && !robot.oa.isManeuvering(); ms++) robot.step();
+    CHECK(robot.oa.isManeuvering(), "no escape from an obstacle at 120mm");
+    while (robot.motors.isBraking() && braked < 1000) {
+        robot.step();
+        braked++;
+    }
+    CHECK(braked >= (long)brakeTime, "%s brake of %u ms released after %ld ms",
+          navigating ? "navigate()" : "check()", brakeTime, braked);
+    CHECK(robot.world.clearance() > 0, "drove into the obstacle");
+}
+
+// The robot starts up against an obstacle inside the sensor's 20mm
+// blind zone. That reads as too close, not as a missing echo, and must
+// trigger the critical escape rather than driving on
+static void checkTooClose(bool navigating) {
+    Robot robot;
+    robot.world.addWall(15, -500, 15, 500);
+    robot.motors.setSpeed(120);
+    if (navigating) robot.oa.startNavigation();
+    else robot.oa.enable();
+
+    for (long ms = 0; ms < 300 && !robot.oa.isManeuvering(); ms++) robot.step();
+    CHECK(robot.sensor.getReading().status == RANGE_TOO_CLOSE, "obstacle at 15mm read as %s",
+          UltrasonicSensor::statusName(robot.sensor.getReading().status));
+    CHECK(robot.oa.isManeuvering() && robot.motors.isBraking(), "%s ignored an obstacle at 15mm",
+          navigating ? "navigate()" : "check()");
+    CHECK(robot.world.x < 15, "drove into the obstacle");
+}
+
+// Driving head-on at a wall from rest: how far out each reaction came,
+// in mm, 0 for one that never did, and the warning the first gave at the
+// speed the robot had reached
+struct Approach {
+    double slowAt, turnAt, escapeAt;
+    double warning; // ms to impact at the first reaction
+    bool emergency;
+};
+
+static Approach approachWall(AvoidanceMode mode, int speed) {
+    Robot robot;
+    robot.world.addWall(3500, -5000, 3500, 5000);
+    robot.oa.setMode(mode);
+    robot.motors.setSpeed(speed);
+    robot.oa.startNavigation();
+
+    Approach result = {0, 0, 0, 0, false};
+    for (long ms = 0; ms < 15000 && result.escapeAt == 0; ms++) {
+        double speedBefore = robot.world.speed();
+        robot.step();
+        double range = robot.world.clearance();
+        bool reacted = result.slowAt != 0 || result.turnAt != 0;
+        if (robot.oa.isManeuvering()) {
+            result.escapeAt = range;
+            result.emergency = robot.motors.isBraking();
+        }
+        else if (result.turnAt == 0 && robot.motors.getLeftOutput() != robot.motors.getRightOutput()) {
+            result.turnAt = range;
+        }
+        else if (result.slowAt == 0 && robot.motors.getSpeedLimit() < speed) {
+            result.slowAt = range;
+        }
+        if (!reacted && (result.slowAt != 0 || result.turnAt != 0 || result.escapeAt != 0)) {
+            result.warning = range / speedBefore * 1000;
+        }
+    }
+    return result;
+}
+
+// The fixed thresholds react at the same distance whatever the speed,
+// leaving under half the warning at full speed that they give at 80.
+// Time-to-collision scales them with speed, so every speed gets about
+// the same warning: earlier when fast, later, and so further along,
+// when slow. Its profile is graded, slowing before turning
+static void checkApproach() {
+    const int speeds[] = {80, 120, 160, 200, 255};
+    double fixedWarning[5], ttcWarning[5];
+    double fixedTurn[5], ttcTurn[5];
+    printf("Approach  speed  slow  turn  escape  warning (mm, ms)\n");
+    for (int i = 0; i < 5; i++) {
+        for (AvoidanceMode mode : {AVOID_FIXED, AVOID_TTC}) {
+            Approach a = approachWall(mode, speeds[i]);
+            printf("%-8s %6d %5.0f %5.0f %7.0f %8.0f%s\n", mode == AVOID_FIXED ? "fixed" : "ttc", speeds[i],
+                   a.slowAt, a.turnAt, a.escapeAt, a.warning, a.emergency ? " emergency" : "");
+            if (mode == AVOID_FIXED) {
+                fixedWarning[i] = a.warning;
+                fixedTurn[i] = a.turnAt;
+                continue;
+            }
+            ttcWarning[i] = a.warning;
+            ttcTurn[i] = a.turnAt;
+            CHECK(a.slowAt > a.turnAt && a.turnAt > a.escapeAt, "speed %d: slow, turn and escape out of order",
+                  speeds[i]);
+            CHECK(!a.emergency, "speed %d: emergency stop in TTC mode", speeds[i]);
+        }
+    }
+    CHECK(fixedWarning[4] < fixedWarning[0] / 2, "fixed warning %.0f ms at 255, %.0f ms at 80", fixedWarning[4],
+          fixedWarning[0]);
+    for (int i = 0; i < 5; i++) {
+        CHECK(ttcWarning[i] > 2000 && ttcWarning[i] < 3000, "TTC warning %.0f ms at speed %d", ttcWarning[i],
+              speeds[i]);
+    }
+    CHECK(ttcTurn[4] > fixedTurn[4] * 2, "TTC turned at %.0f mm at full speed, fixed at %.0f mm", ttcTurn[4],
+          fixedTurn[4]);
+    CHECK(ttcTurn[0] < fixedTurn[0], "TTC turned at %.0f mm at speed 80, fixed at %.0f mm", ttcTurn[0],
+          fixedTurn[0]);
+}
+
+// A dead end to drive into, and when the robot counts as out of it
+struct DeadEnd {
+    const char* name;
+    std::vector<Wall> walls;
+    bool (*cleared)(SimWorld& world);
+};
+
+static bool outBack(SimWorld& world) {
+    return world.x < -1000;
+}
+
+static const DeadEnd DEAD_ENDS[] = {
+    {"narrow", {{-1000, -300, 1500, -300}, {-1000, 300, 1500, 300}, {1500, -300, 1500, 300}}, outBack},
+    {"corridor", {{-1000, -450, 1500, -450}, {-1000, 450, 1500, 450}, {1500, -450, 1500, 450}}, outBack},
+    {"corner right", {{-1000, -450, 1500, -450}, {1500, -450, 1500, 2500}},
+     [](SimWorld& w) { return w.y > 1500 || w.x < -1000; }},
+    {"corner left", {{-1000, 450, 1500, 450}, {1500, 450, 1500, -2500}},
+     [](SimWorld& w) { return w.y < -1500 || w.x < -1000; }},
+    {"pocket", {{-500, -500, 1200, -500}, {-500, 500, 1200, 500}, {1200, -500, 1200, 500}, {-500, 500, -500, 0}},
+     [](SimWorld& w) { return w.x < -500; }},
+};
+
+struct Clearing {
+    double seconds; // Until out of the dead end, 0 if not within a minute
+    int escapes;
+    int maxEscalation;
+    double closest; // mm, nearest the robot's centre came to a wall
+};
+
+// forget wipes the escape memory after every escape, which is how the
+// avoidance behaved before it had one
+static Clearing clearDeadEnd(const DeadEnd& map, bool forget) {
+    Robot robot;
+    robot.world.maxSpeed = 300; // The pose model's default
+    for (const Wall& w : map.walls) robot.world.walls.push_back(w);
+    robot.motors.setSpeed(200);
+    robot.oa.startNavigation();
+
+    Clearing result = {0, 0, 0, 1e9};
+    bool maneuvering = false;
+    for (long ms = 0; ms < 60000; ms++) {
+        robot.step();
+        if (robot.oa.isManeuvering() && !maneuvering) {
+            result.escapes++;
+            result.maxEscalation = max(result.maxEscalation, (int)robot.oa.getEscalation());
+        }
+        maneuvering = robot.oa.isManeuvering();
+        result.closest = min(result.closest, robot.world.clearance());
+        if (forget && !maneuvering) robot.oa.clearStats();
+        if (map.cleared(robot.world)) {
+            result.seconds = ms / 1000.0;
+            break;
+        }
+    }
+    return result;
+}
+
+// Time to clear each dead end with and without the escape memory. The
+// narrow corridor is where a robot that always rotates the same short
+// way ping-pongs between the walls
+static void checkDeadEnds() {
+    printf("Dead end      without memory        with memory\n");
+    printf("              s  escapes closest    s  escapes level closest\n");
+    double before = 0, after = 0;
+    for (const DeadEnd& map : DEAD_ENDS) {
+        Clearing plain = clearDeadEnd(map, true);
+        Clearing memory = clearDeadEnd(map, false);
+        printf("%-12s %5.1f %4d %6.0f %8.1f %4d %5d %6.0f\n", map.name, plain.seconds, plain.escapes, plain.closest,
+               memory.seconds, memory.escapes, memory.maxEscalation, memory.closest);
+        CHECK(memory.seconds > 0, "%s: still in the dead end after a minute", map.name);
+        before += plain.seconds;
+        after += memory.seconds;
+    }
+
+    Clearing plain = clearDeadEnd(DEAD_ENDS[0], true);
+    Clearing memory = clearDeadEnd(DEAD_ENDS[0], false);
+    CHECK(memory.seconds < plain.seconds * 0.8 && memory.escapes < plain.escapes,
+          "narrow corridor: %.1f s and %d escapes with memory, %.1f s and %d without", memory.seconds,
+          memory.escapes, plain.seconds, plain.escapes);
+    CHECK(after < before, "all dead ends: %.1f s with memory, %.1f s without", after, before);
+}
+
+int main() {
+    checkDeadEnds();
+    checkApproach();
+    checkCriticalBrake(false, 150);
+    checkCriticalBrake(true, 150);
+    checkCriticalBrake(true, 300);
+    checkTooClose(false);
+    checkTooClose(true);
+    return checkResult("obstacle avoidance");
+}
@@ -0,0 +1,173 @@
+// Odometry against dead reckoning in double precision, both fed the
+// same wheel travel from MotorController's time x PWM model over a
+// drive of straights, arcs and spins
+#include <Arduino.h>
+#include "Odometry.h"
+#include "PinChange.h"
+#include "check.h"
+
+PIN_CHANGE_ISR(1);
+
+struct Segment {
+    int left, right; // PWM
+    long ms;
+};
+
+static const Segment DRIVE[] = {
+    {200, 200, 3000},   {200, 120, 4000},  {-150, 150, 2500}, {120, 200, 4000},  {255, 255, 2000},
+    {-180, -180, 1500}, {150, -150, 9000}, {90, 220, 6000},   {220, 90, 6000},   {-200, -120, 3000},
+    {0, 0, 500},        {60, 200, 5000},   {-150, 150, 9000}, {255, 250, 10000}, {100, 100, 2000},
+};
+
+// Exact arc integration every millisecond, in mm and radians
+struct FloatPose {
+    double x, y, heading;
+    long lastLeft, lastRight;
+
+    void step(long left, long right, double track) {
+        double dl = (left - lastLeft) / 1000.0, dr = (right - lastRight) / 1000.0;
+        lastLeft = left;
+        lastRight = right;
+        double turn = (dr - dl) / track;
+        double center = (dl + dr) / 2;
+        double chord = fabs(turn) < 1e-9 ? center : center * sin(turn / 2) / (turn / 2);
+        x += chord * cos(heading + turn / 2);
+        y += chord * sin(heading + turn / 2);
+        heading += turn;
+    }
+
+    // Heading in centidegrees, wrapped like Odometry::getHeading()
+    double headingCd() {
+        double cd = fmod(heading * 18000 / M_PI, 36000);
+        if (cd > 18000) cd -= 36000;
+        if (cd < -18000) cd += 36000;
+        return cd;
+    }
+};
+
+static void checkTrajectory() {
+    MotorController motors(3, 4, 5, 6, 9, 10);
+    motors.begin();
+    motors.setTrackWidth(130);
+    motors.setPwmModel(300, 40);
+    motors.setRamp(0, 0);
+    Odometry odometry(&motors);
+    odometry.begin();
+    FloatPose reference = {0, 0, 0, motors.getWheelTravel(WHEEL_LEFT), motors.getWheelTravel(WHEEL_RIGHT)};
+
+    double worstPosition = 0, worstHeading = 0;
+    for (const Segment& segment : DRIVE) {
+        motors.setWheelSpeeds(segment.left, segment.right);
+        for (long ms = 0; ms < segment.ms; ms++) {
+            simTime += 1000;
+            motors.update();
+            odometry.update();
+            reference.step(motors.getWheelTravel(WHEEL_LEFT), motors.getWheelTravel(WHEEL_RIGHT),
+                           motors.getTrackWidth());
+        }
+        worstPosition = max(worstPosition, hypot(odometry.getX() - reference.x, odometry.getY() - reference.y));
+        double headingError = fabs(odometry.getHeading() - reference.headingCd());
+        worstHeading = max(worstHeading, min(headingError, 36000 - headingError));
+    }
+    CHECK(worstPosition <= 5, "pose %.1f mm from the float reference", worstPosition);
+    CHECK(worstHeading <= 10, "heading %.0f centidegrees from the float reference", worstHeading);
+    CHECK(fabs(reference.heading) > 4 * M_PI, "drive never turned far enough to test heading drift");
+
+    // reset() starts over from wherever the wheels are
+    odometry.reset();
+    CHECK(odometry.getX() == 0 && odometry.getY() == 0 && odometry.getHeading() == 0, "reset() kept the pose");
+}
+
+// One update that sees a long step, as when loop() sat in a delay while
+// the wheels turned: a 500 mm straight and a spin with the wheels 600 mm
+// apart. Either overflowed the 32-bit products in one piece
+static void checkLongStep(int left, int right, long ms) {
+    MotorController motors(3, 4, 5, 6, 9, 10);
+    motors.begin();
+    motors.setTrackWidth(130);
+    motors.setPwmModel(300, 0);
+    motors.setRamp(0, 0);
+    Odometry odometry(&motors);
+    odometry.begin();
+    FloatPose reference = {0, 0, 0, motors.getWheelTravel(WHEEL_LEFT), motors.getWheelTravel(WHEEL_RIGHT)};
+
+    motors.setWheelSpeeds(left, right);
+    for (long i = 0; i < ms; i++) {
+        simTime += 1000;
+        motors.update();
+        reference.step(motors.getWheelTravel(WHEEL_LEFT), motors.getWheelTravel(WHEEL_RIGHT),
+                       motors.getTrackWidth());
+    }
+    odometry.update();
+
+    long stepLeft = motors.getWheelTravel(WHEEL_LEFT) / 1000;
+    long stepRight = motors.getWheelTravel(WHEEL_RIGHT) / 1000;
+    double position = hypot(odometry.getX() - reference.x, odometry.getY() - reference.y);
+    double headingError = fabs(odometry.getHeading() - reference.headingCd());
+    headingError = min(headingError, 36000 - headingError);
+    CHECK(position <= 2 && headingError <= 10,
+          "step of %ld/%ld mm: pose %ld, %ld mm at %d cd, reference %.0f, %.0f mm at %.0f cd", stepLeft, stepRight,
+          (long)odometry.getX(), (long)odometry.getY(), odometry.getHeading(), reference.x, reference.y,
+          reference.headingCd());
+}
+
+// arc() bends round the radius it is given, whatever the track width:
+// the wheel outputs keep the ratio the radius implies, and the pose
+// follows the circle to within what 8-bit PWM can resolve. Without a
+// dead band the model's wheel speeds keep the PWM ratio
+static void checkArcRadius(uint16_t track, int radius) {
+    MotorController motors(3, 4, 5, 6, 9, 10);
+    motors.begin();
+    motors.setTrackWidth(track);
+    motors.setPwmModel(300, 0);
+    motors.setRamp(0, 0);
+    Odometry odometry(&motors);
+    odometry.begin();
+
+    const int speed = 250;
+    motors.arc(speed, radius);
+    simTime += 1000;
+    motors.update();
+    double inner = speed * (2.0 * abs(radius) - track) / (2.0 * abs(radius) + track);
+    int innerOutput = radius >= 0 ? motors.getLeftOutput() : motors.getRightOutput();
+    int outerOutput = radius >= 0 ? motors.getRightOutput() : motors.getLeftOutput();
+    CHECK(outerOutput == speed && fabs(innerOutput - inner) < 1, "arc of %d mm: inner wheel at %d, not %.1f", radius,
+          innerOutput, inner);
+
+    double worst = 0, farthest = 0;
+    for (long ms = 0; ms < 4000; ms++) {
+        simTime += 1000;
+        motors.update();
+        odometry.update();
+        // The turn centre sits at (0, radius)
+        worst = max(worst, fabs(hypot(odometry.getX(), odometry.getY() - radius) - abs(radius)));
+        farthest = max(farthest, hypot(odometry.getX(), odometry.getY()));
+    }
+    CHECK(worst <= abs(radius) * 0.05 + 2, "arc of %d mm with a %u mm track strayed %.1f mm off the circle", radius,
+          track, worst);
+    CHECK(farthest >= abs(radius), "arc of %d mm never left the start", radius);
+}
+
+// Encoders on A4 and pin 8: A4's pin change group is claimed, pin 8's
+// is not. The failed attach must not leave A4 raising interrupts
+static void checkEncoderAttachFailure() {
+    MotorController motors(3, 4, 5, 6, 9, 10);
+    motors.begin();
+    CHECK(!motors.attachEncoders(A4, 8), "encoder attached to an unclaimed pin change group");
+    CHECK(!(PCMSK1 & (1 << 4)) && !(PCICR & (1 << 1)), "left encoder left on the pin change interrupt");
+
+    CHECK(motors.attachEncoders(A4, A5), "encoders on A4 and A5 refused");
+    CHECK((PCMSK1 & (1 << 4)) && (PCMSK1 & (1 << 5)) && (PCICR & (1 << 1)), "encoders not on the interrupt");
+}
+
+int main() {
+    checkTrajectory();
+    checkLongStep(255, 255, 1670);
+    checkLongStep(-255, 255, 1000);
+    checkArcRadius(130, 500);
+    checkArcRadius(130, -300);
+    checkArcRadius(200, 150);
+    checkArcRadius(130, 65);
+    checkEncoderAttachFailure();
+    return checkResult("odometry");
+}
@@ -0,0 +1,70 @@
+// SweepScanner's bins and its heading handoff to navigation
+#include <Arduino.h>
+#include "SweepScanner.h"
+#include "sim_world.h"
+#include "check.h"
+
+// Every step covers 0-180 degrees in whole bins, ending on 180, within
+// the histogram; steps that don't divide 180 round down to one that does
+static void checkBins() {
+    MotorController motors(3, 4, 5, 6, 9, 10);
+    UltrasonicSensor sensor(12, 2);
+    RobotArm arm(13, 7, 8, 11);
+    SweepScanner scanner(&arm, &sensor);
+    for (int degrees = 0; degrees <= 100; degrees++) {
+        scanner.setResolution(degrees);
+        int step = scanner.getResolution();
+        int last = scanner.getBinCount() - 1;
+        CHECK(step >= 5 && 180 % step == 0 && step <= max(degrees, 5), "step of %d became %d", degrees, step);
+        CHECK(scanner.getBinCount() <= 37, "step of %d: %d bins", degrees, scanner.getBinCount());
+        CHECK(scanner.getBinAngle(0) == 0 && scanner.getBinAngle(last) == 180, "step of %d: bins cover %d to %d",
+              degrees, scanner.getBinAngle(0), scanner.getBinAngle(last));
+    }
+}
+
+// Navigation stops for a scan, and the sensor goes quiet so every bin
+// waits out its reading: the slowest a 5 degree scan can be. Navigation
+// must wait for its heading rather than give up and escape blind
+static void checkSlowScanHandoff() {
+    MotorController motors(3, 4, 5, 6, 9, 10);
+    UltrasonicSensor sensor(12, 2);
+    ObstacleAvoidance oa(&motors, &sensor);
+    SimWorld world(&motors, &sensor);
+    RobotArm arm(13, 7, 8, 11);
+    SweepScanner scanner(&arm, &sensor, &oa);
+    motors.begin();
+    sensor.begin();
+    oa.begin();
+    arm.begin();
+
+    world.addWall(2000, -500, 2000, 500);
+    scanner.setResolution(5);
+    oa.setScanOnStop(true);
+    motors.setSpeed(200);
+    oa.startNavigation();
+
+    bool requested = false, gaveUp = false;
+    for (long ms = 0; ms < 30000 && !scanner.isDone(); ms++) {
+        world.step([&]() {
+            motors.update();
+            if (!requested) sensor.update();
+            oa.update();
+            scanner.update();
+            arm.update();
+        });
+        if (oa.isAwaitingHeading()) requested = true;
+        if (requested && !oa.isAwaitingHeading() && !scanner.isDone()) gaveUp = true;
+    }
+    CHECK(requested, "navigation never asked for a heading");
+    CHECK(scanner.isDone(), "scan never finished");
+    CHECK(scanner.getScanTime() > 5000 && scanner.getScanTime() <= scanner.getScanTimeBound(),
+          "scan took %lu ms, bound %lu ms", (unsigned long)scanner.getScanTime(),
+          (unsigned long)scanner.getScanTimeBound());
+    CHECK(!gaveUp, "navigation gave up on a %lu ms scan", (unsigned long)scanner.getScanTime());
+}
+
+int main() {
+    checkBins();
+    checkSlowScanHandoff();
+    return checkResult("sweep scanner");
+}
@@ -0,0 +1,205 @@
+// Ultrasonic ranging: echo capture on the side sensor pins, the
+// fixed-point distance against a float reference, and the filters
+#include <Arduino.h>
+#include "UltrasonicSensor.h"
+#include "PinChange.h"
+#include "check.h"
+
+PIN_CHANGE_ISR(1);
+
+static const uint8_t SIDE_TRIG_PIN = A0;
+static const uint8_t SIDE_ECHO_PIN = A1;
+static const uint8_t ENCODER_PIN = A4; // Same pin change group
+
+static void setEchoPin(uint8_t pin, uint8_t level) {
+    setPin(pin, level);
+    pinChange1();
+}
+
+// One ping answered by an echo lasting duration us
+static RangeReading rangeEcho(UltrasonicSensor& sensor, uint32_t duration) {
+    sensor.startPing();
+    simTime += 450;
+    setEchoPin(SIDE_ECHO_PIN, HIGH);
+    simTime += duration;
+    setEchoPin(SIDE_ECHO_PIN, LOW);
+    sensor.update();
+    return sensor.getReading();
+}
+
+// A side sensor has no external interrupt on its echo pin. Its echo is
+// timed through the pin change interrupt, so startPing() returns at once
+// instead of sitting in pulseIn() for the whole echo
+static void checkSideEcho() {
+    UltrasonicSensor side(SIDE_TRIG_PIN, SIDE_ECHO_PIN);
+    side.begin();
+    side.setMaxRange(1500);
+    side.setAutoTrigger(false);
+    CHECK((PCICR & (1 << 1)) && (PCMSK1 & (1 << 1)), "echo pin not on the pin change interrupt");
+
+    pulseInResult = 2941; // What a blocking read would wait for
+    uint32_t start = simTime;
+    side.startPing();
+    CHECK(simTime - start < 100, "startPing() blocked for %u us", (unsigned)(simTime - start));
+    CHECK(side.isBusy(), "no ping in flight");
+
+    // 500mm away at 340 m/s, with an encoder edge in the middle of it
+    simTime = start + 450;
+    setEchoPin(SIDE_ECHO_PIN, HIGH);
+    simTime += 1000;
+    setEchoPin(ENCODER_PIN, HIGH);
+    simTime += 1941;
+    setEchoPin(SIDE_ECHO_PIN, LOW);
+    side.update();
+    RangeReading reading = side.getReading();
+    CHECK(!side.isBusy() && reading.status == RANGE_VALID, "echo read as %s",
+          UltrasonicSensor::statusName(reading.status));
+    CHECK(abs(reading.distanceMm - 500) <= 1, "echo at 500mm read as %u mm", reading.distanceMm);
+
+    // Nothing in range: the ping times out in update() without blocking
+    pulseInResult = 0;
+    start = simTime;
+    side.startPing();
+    CHECK(simTime - start < 100, "startPing() blocked for %u us", (unsigned)(simTime - start));
+    while (side.isBusy() && simTime - start < 100000) {
+        simTime += 1000;
+        side.update();
+    }
+    CHECK(side.getReading().status == RANGE_NO_ECHO, "missing echo read as %s",
+          UltrasonicSensor::statusName(side.getReading().status));
+}
+
+// Echo time to millimetres in Q16 fixed point, against the float
+// formula at temperatures from -20 to 50 C and every 7 us of echo up to
+// the 4m maximum range
+static void checkFixedPointDistance() {
+    UltrasonicSensor sensor(SIDE_TRIG_PIN, SIDE_ECHO_PIN);
+    sensor.begin();
+    sensor.setAutoTrigger(false);
+    sensor.setMaxRange(4000);
+
+    int tested = 0;
+    for (int celsius = -20; celsius <= 50; celsius += 5) {
+        sensor.setTemperature(celsius);
+        double halfSpeed = (331.3 + 0.606 * celsius) / 2000; // mm/us
+        double worst = 0;
+        for (uint32_t duration = 100; duration * halfSpeed <= 4000; duration += 7) {
+            RangeReading reading = rangeEcho(sensor, duration);
+            double expected = duration * halfSpeed;
+            if (expected < 20.5 || expected > 3999.5) continue; // Near the status limits
+            CHECK(reading.status == RANGE_VALID, "%u us at %d C read as %s", (unsigned)duration, celsius,
+                  UltrasonicSensor::statusName(reading.status));
+            worst = max(worst, fabs(reading.distanceMm - expected));
+            tested++;
+        }
+        CHECK(worst <= 1.0, "%d C: off the float distance by %.2f mm", celsius, worst);
+    }
+    CHECK(tested > 15000, "only %d echoes in range", tested);
+
+    // The default speed of sound, with no temperature set
+    sensor.disableTemperatureCompensation();
+    CHECK(rangeEcho(sensor, 5882).distanceMm == 1000, "5882 us read as %u mm", rangeEcho(sensor, 5882).distanceMm);
+    CHECK(rangeEcho(sensor, 100).status == RANGE_TOO_CLOSE, "17mm not too close");
+    CHECK(rangeEcho(sensor, 23600).status == RANGE_OUT_OF_RANGE, "4012mm not out of range");
+}
+
+// One ping of a trace in mm at the default speed of sound, 0 for a
+// ping that gets no echo
+static void feed(UltrasonicSensor& sensor, uint16_t mm) {
+    if (mm != 0) {
+        rangeEcho(sensor, (uint32_t)(mm / 0.17 + 0.5));
+        return;
+    }
+    sensor.startPing();
+    while (sensor.isBusy()) {
+        simTime += 1000;
+        sensor.update();
+    }
+}
+
+static UltrasonicSensor* filteredSensor(FilterMode mode) {
+    static UltrasonicSensor sensor(SIDE_TRIG_PIN, SIDE_ECHO_PIN);
+    sensor.begin();
+    sensor.setAutoTrigger(false);
+    sensor.disableTemperatureCompensation();
+    sensor.setFilterMode(mode);
+    sensor.setSmoothing(77);
+    sensor.clearFilter();
+    return &sensor;
+}
+
+// A wall held at 800mm, with the multipath spikes, crosstalk and missed
+// echoes an HC-SR04 gives off a hard wall at an angle. The median keeps
+// every one of them out of the filtered distance
+static void checkSpikeRejection() {
+    static const uint16_t trace[] = {801, 799, 803, 800, 1650, 798, 802, 0, 800, 797, 2410, 801,
+                                     799, 803, 120, 800, 802, 0, 0, 799, 801, 3120, 800, 798};
+    UltrasonicSensor* sensor = filteredSensor(FILTER_MEDIAN);
+    uint16_t rawWorst = 0, medianWorst = 0;
+    for (uint16_t mm : trace) {
+        feed(*sensor, mm);
+        rawWorst = max(rawWorst, (uint16_t)abs(sensor->getDistanceMm() - 800));
+        medianWorst = max(medianWorst, (uint16_t)abs(sensor->getFilteredDistanceMm(3) - 800));
+        medianWorst = max(medianWorst, (uint16_t)abs(sensor->getFilteredDistanceMm(5) - 800));
+    }
+    CHECK(rawWorst > 2000, "trace spikes never reached the raw distance");
+    CHECK(medianWorst <= 5, "median let through a spike %u mm off", medianWorst);
+}
+
+// Jitter of up to 25mm around 500mm: the moving average must cut its
+// RMS error to under half of the raw readings'
+static void checkNoiseSmoothing() {
+    UltrasonicSensor* sensor = filteredSensor(FILTER_EMA);
+    uint32_t seed = 12345;
+    double rawSquares = 0, emaSquares = 0;
+    for (int i = 0; i < 200; i++) {
+        seed = seed * 1103515245 + 12345;
+        feed(*sensor, 500 + (int)((seed >> 16) % 51) - 25);
+        if (i < 20) continue; // Settling
+        rawSquares += sq(sensor->getDistanceMm() - 500.0);
+        emaSquares += sq(sensor->getFilteredDistanceMm() - 500.0);
+    }
+    double rawRms = sqrt(rawSquares / 180), emaRms = sqrt(emaSquares / 180);
+    CHECK(emaRms < rawRms / 2, "moving average RMS error %.1f mm against %.1f mm raw", emaRms, rawRms);
+}
+
+// Samples after the wall steps from 1000 to 600mm until the filtered
+// distance is within 10mm of it
+static int stepLag(FilterMode mode, uint8_t samples, uint8_t alpha) {
+    UltrasonicSensor* sensor = filteredSensor(mode);
+    sensor->setSmoothing(alpha);
+    for (int i = 0; i < 10; i++) feed(*sensor, 1000);
+    for (int lag = 1; lag <= 50; lag++) {
+        feed(*sensor, 600);
+        if (abs(sensor->getFilteredDistanceMm(samples) - 600) <= 10) return lag;
+    }
+    return 99;
+}
+
+static void checkStepResponse() {
+    CHECK(stepLag(FILTER_MEDIAN, 3, 77) == 2, "median of 3 took %d samples", stepLag(FILTER_MEDIAN, 3, 77));
+    CHECK(stepLag(FILTER_MEDIAN, 5, 77) == 3, "median of 5 took %d samples", stepLag(FILTER_MEDIAN, 5, 77));
+    // 400mm * (1 - 77/256)^n falls under 10mm at n = 11, and 6 at alpha 0.5
+    CHECK(stepLag(FILTER_EMA, 3, 77) == 11, "moving average took %d samples", stepLag(FILTER_EMA, 3, 77));
+    CHECK(stepLag(FILTER_EMA, 3, 128) == 6, "alpha 0.5 took %d samples", stepLag(FILTER_EMA, 3, 128));
+
+    // Reading the filter never waits, and re-reading adds no samples
+    UltrasonicSensor* sensor = filteredSensor(FILTER_MEDIAN);
+    for (int i = 0; i < 5; i++) feed(*sensor, 1000);
+    feed(*sensor, 600);
+    uint32_t start = simTime;
+    for (int i = 0; i < 10; i++) {
+        CHECK(sensor->getFilteredDistanceMm(3) == 1000, "re-reading moved the median to %u mm",
+              sensor->getFilteredDistanceMm(3));
+    }
+    CHECK(simTime == start, "filtered read blocked for %u us", (unsigned)(simTime - start));
+}
+
+int main() {
+    checkSideEcho();
+    checkFixedPointDistance();
+    checkSpikeRejection();
+    checkNoiseSmoothing();
+    checkStepResponse();
+    return checkResult("ultrasonic");
+}
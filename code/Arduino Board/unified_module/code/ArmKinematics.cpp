@@ -0,0 +1,100 @@
+#include "ArmKinematics.h"
+#include "FixedTrig.h"
+
+ArmKinematics::ArmKinematics(int height, int upper, int fore) {
+    setLinks(height, upper, fore);
+}
+
+// Links are kept under 250mm so the squared lengths scaled to Q13 in
+// inverse() stay within a long
+void ArmKinematics::setLinks(int height, int upper, int fore) {
+    baseHeight = constrain(height, 0, 250);
+    upperArm = constrain(upper, 1, 250);
+    forearm = constrain(fore, 1, 250);
+}
+
+// Divides by 2^bits, rounding to nearest rather than toward zero
+static long scaleDown(long value, int bits) {
+    long half = 1L << (bits - 1);
+    return (value + (value < 0 ? -half : half)) / (1L << bits);
+}
+
+// Nearest whole degree, so a slightly negative angle stays negative
+// and fails the joint limit check
+static int toDegrees(long centidegrees) {
+    return (centidegrees + (centidegrees < 0 ? -50 : 50)) / 100;
+}
+
+ArmPoint ArmKinematics::forward(int base, int shoulder, int elbow) {
+    // Forearm elevation, centidegrees
+    long shoulderAngle = shoulder * 100L;
+    long forearmAngle = (shoulder + elbow - 180) * 100L;
+
+    // mm, Q14 until the end so the rounding happens once
+    long reach = (long)upperArm * fixedCos(shoulderAngle) + (long)forearm * fixedCos(forearmAngle);
+    long height = (long)upperArm * fixedSin(shoulderAngle) + (long)forearm * fixedSin(forearmAngle);
+    long yaw = (base - 90) * 100L;
+
+    // Reach drops to Q4 first so the product with a Q14 cosine fits
+    long reachQ4 = scaleDown(reach, 10);
+    ArmPoint point;
+    point.x = scaleDown(reachQ4 * fixedCos(yaw), 18);
+    point.y = scaleDown(reachQ4 * fixedSin(yaw), 18);
+    point.z = baseHeight + scaleDown(height, 14);
+    return point;
+}
+
+// Solves base, shoulder and elbow for the target with the elbow above
+// the line from shoulder to gripper. angles is only written on REACH_OK
+ReachStatus ArmKinematics::inverse(ArmPoint target, int angles[3]) {
+    long longest = upperArm + forearm;
+    long shortest = abs(upperArm - forearm);
+    long height = (long)target.z - baseHeight;
+
+    // Rules out far targets before squaring them
+    if (abs(target.x) > longest || abs(target.y) > longest || abs(height) > longest) return REACH_TOO_FAR;
+
+    long yaw = fixedAtan2(target.y, target.x);
+    long reachSq = (long)target.x * target.x + (long)target.y * target.y;
+    long reach = fixedSqrt(reachSq);
+
+    // Shoulder to gripper distance, against what the two links span
+    long distanceSq = reachSq + height * height;
+    if (distanceSq > longest * longest) return REACH_TOO_FAR;
+    if (distanceSq < shortest * shortest || distanceSq == 0) return REACH_TOO_CLOSE;
+
+    // Law of cosines for the elbow, as a Q14 cosine
+    long upperSq = (long)upperArm * upperArm;
+    long foreSq = (long)forearm * forearm;
+    long elbowCos = (upperSq + foreSq - distanceSq) * 8192L / ((long)upperArm * forearm);
+    long elbow = fixedAcos(elbowCos);
+
+    // The gripper lies below the upper arm by the angle the bent forearm
+    // makes at the shoulder, taken from the solved elbow so both stay
+    // consistent near full stretch
+    long along = (long)upperArm * TRIG_ONE - (long)forearm * fixedCos(elbow);
+    long across = (long)forearm * fixedSin(elbow);
+    long shoulder = fixedAtan2(height, reach) + fixedAtan2(across, along);
+
+    int base = toDegrees(9000 + yaw);
+    int shoulderDeg = toDegrees(shoulder);
+    int elbowDeg = toDegrees(elbow);
+    if (base < 0 || base > 180 || shoulderDeg < 0 || shoulderDeg > 180 || elbowDeg < 0 || elbowDeg > 180) {
+        return REACH_JOINT_LIMIT;
+    }
+
+    angles[0] = base;
+    angles[1] = shoulderDeg;
+    angles[2] = elbowDeg;
+    return REACH_OK;
+}
+
+const char* ArmKinematics::statusName(ReachStatus status) {
+    switch (status) {
+        case REACH_OK: return "ok";
+        case REACH_TOO_FAR: return "too far";
+        case REACH_TOO_CLOSE: return "too close";
+        case REACH_JOINT_LIMIT: return "joint limit";
+    }
+    return "unknown";
+}
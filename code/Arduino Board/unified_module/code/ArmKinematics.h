@@ -0,0 +1,41 @@
+#ifndef ARM_KINEMATICS_H
+#define ARM_KINEMATICS_H
+
+#include <Arduino.h>
+
+// Gripper tip position in mm from the base axis at the base plate:
+// x straight ahead, y to the left, z up
+struct ArmPoint {
+    int x;
+    int y;
+    int z;
+};
+
+enum ReachStatus {
+    REACH_OK,
+    REACH_TOO_FAR,    // Beyond the stretched-out arm
+    REACH_TOO_CLOSE,  // Inside what the folded elbow allows
+    REACH_JOINT_LIMIT // Would need a servo outside 0-180 degrees
+};
+
+// Planar arm on a turning base: the shoulder pivots baseHeight above
+// the base plate, then the upper arm and forearm. Servo angles are in
+// degrees:
+// - base 90 faces along x, higher turns to the left
+// - shoulder is the upper arm's elevation, 90 points straight up
+// - elbow is the angle between upper arm and forearm, 180 is straight
+class ArmKinematics {
+  private:
+    int baseHeight; // mm
+    int upperArm;   // mm, shoulder to elbow axis
+    int forearm;    // mm, elbow axis to gripper tip
+
+  public:
+    ArmKinematics(int baseHeight, int upperArm, int forearm);
+    void setLinks(int baseHeight, int upperArm, int forearm);
+    ArmPoint forward(int base, int shoulder, int elbow);
+    ReachStatus inverse(ArmPoint target, int angles[3]);
+    static const char* statusName(ReachStatus status);
+};
+
+#endif
@@ -0,0 +1,54 @@
+#include "CurrentMonitor.h"
+
+CurrentMonitor::CurrentMonitor() {
+    stallLimit = 1500;
+    stallSamples = 10;
+    peakLimit = 3000;
+    reset();
+}
+
+void CurrentMonitor::setLimits(uint16_t stallMa, uint8_t samples, uint16_t peakMa) {
+    stallLimit = stallMa;
+    stallSamples = max(samples, (uint8_t)1);
+    peakLimit = peakMa;
+}
+
+// Returns true on the sample that trips, then starts over with an
+// empty window
+bool CurrentMonitor::addSample(uint16_t mA) {
+    if (count == WINDOW_SIZE) sum -= window[head];
+    else count++;
+    window[head] = mA;
+    sum += mA;
+    head = (head + 1) % WINDOW_SIZE;
+
+    // A short is over the peak limit from the first sample on
+    overPeak = mA >= peakLimit ? overPeak + 1 : 0;
+    bool tripped = overPeak >= PEAK_SAMPLES;
+
+    // A stall only counts once the window is full, so start-up inrush
+    // is averaged out
+    if (count == WINDOW_SIZE && getAverage() >= stallLimit) {
+        if (overStall < stallSamples) overStall++;
+        if (overStall >= stallSamples) tripped = true;
+    }
+    else {
+        overStall = 0;
+    }
+
+    if (tripped) reset();
+    return tripped;
+}
+
+void CurrentMonitor::reset() {
+    head = 0;
+    count = 0;
+    sum = 0;
+    overStall = 0;
+    overPeak = 0;
+}
+
+uint16_t CurrentMonitor::getAverage() {
+    if (count == 0) return 0;
+    return sum / count;
+}
@@ -0,0 +1,102 @@
+#include "FixedTrig.h"
+
+// sin() of whole degrees 0-90, Q14
+static const int16_t SIN_TABLE[91] PROGMEM = {
+    0, 286, 572, 857, 1143, 1428, 1713, 1997, 2280, 2563,
+    2845, 3126, 3406, 3686, 3964, 4240, 4516, 4790, 5063, 5334,
+    5604, 5872, 6138, 6402, 6664, 6924, 7182, 7438, 7692, 7943,
+    8192, 8438, 8682, 8923, 9162, 9397, 9630, 9860, 10087, 10311,
+    10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+    12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+    14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+    15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+    16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+    16384
+};
+
+// atan() of 0 to 1 in steps of 1/64, centidegrees
+static const int16_t ATAN_TABLE[65] PROGMEM = {
+    0, 90, 179, 268, 358, 447, 536, 624, 713, 800,
+    888, 975, 1062, 1148, 1234, 1319, 1404, 1488, 1571, 1653,
+    1735, 1817, 1897, 1977, 2056, 2134, 2211, 2287, 2363, 2438,
+    2511, 2584, 2657, 2728, 2798, 2867, 2936, 3003, 3070, 3136,
+    3201, 3264, 3327, 3390, 3451, 3511, 3571, 3629, 3687, 3744,
+    3800, 3855, 3909, 3963, 4016, 4067, 4119, 4169, 4218, 4267,
+    4315, 4363, 4409, 4455, 4500
+};
+
+int16_t fixedSin(long centidegrees) {
+    // Fold into 0-360 degrees, then into the first quadrant
+    long angle = centidegrees % 36000;
+    if (angle < 0) angle += 36000;
+    bool negative = angle >= 18000;
+    if (negative) angle -= 18000;
+    if (angle > 9000) angle = 18000 - angle;
+
+    // Linear interpolation between whole degrees, within about 1 LSB
+    int degree = angle / 100;
+    int fraction = angle % 100;
+    int16_t value = pgm_read_word(&SIN_TABLE[degree]);
+    if (fraction > 0) {
+        int16_t next = pgm_read_word(&SIN_TABLE[degree + 1]);
+        value += ((long)(next - value) * fraction + 50) / 100;
+    }
+    return negative ? -value : value;
+}
+
+int16_t fixedCos(long centidegrees) {
+    return fixedSin(centidegrees + 9000);
+}
+
+long fixedAtan2(long y, long x) {
+    if (x == 0 && y == 0) return 0;
+
+    // Fold into the first octant, where the ratio is 0 to 1
+    unsigned long ax = x < 0 ? -x : x;
+    unsigned long ay = y < 0 ? -y : y;
+    bool swapped = ay > ax;
+
+    // Keep the larger one within 19 bits so the Q12 ratio below fits
+    // in 32; dropping low bits of both leaves the angle unchanged
+    while (max(ax, ay) >= (1UL << 19)) {
+        ax >>= 1;
+        ay >>= 1;
+    }
+    unsigned long ratio = swapped ? (ax << 12) / ay : (ay << 12) / ax; // Q12
+
+    // Linear interpolation between the 1/64 steps, within about 0.01 degrees
+    int index = ratio >> 6;
+    int fraction = ratio & 63;
+    long angle = pgm_read_word(&ATAN_TABLE[index]);
+    if (fraction > 0) {
+        int16_t next = pgm_read_word(&ATAN_TABLE[index + 1]);
+        angle += ((next - angle) * fraction + 32) / 64;
+    }
+
+    if (swapped) angle = 9000 - angle;
+    if (x < 0) angle = 18000 - angle;
+    return y < 0 ? -angle : angle;
+}
+
+long fixedAcos(long cosine) {
+    cosine = constrain(cosine, -TRIG_ONE, TRIG_ONE);
+    long sine = fixedSqrt((long)TRIG_ONE * TRIG_ONE - cosine * cosine);
+    return fixedAtan2(sine, cosine);
+}
+
+uint16_t fixedSqrt(uint32_t value) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > value) bit >>= 2;
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
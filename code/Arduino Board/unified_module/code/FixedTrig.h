@@ -0,0 +1,21 @@
+#ifndef FIXED_TRIG_H
+#define FIXED_TRIG_H
+
+#include <Arduino.h>
+
+// Sine and cosine without floating point. Angles are in centidegrees,
+// results are Q14 fixed point (16384 is 1.0)
+const int16_t TRIG_ONE = 16384;
+
+int16_t fixedSin(long centidegrees);
+int16_t fixedCos(long centidegrees);
+
+// Inverses, in centidegrees. fixedAtan2() returns -18000 to 18000 like
+// atan2(), fixedAcos() takes a Q14 cosine and returns 0 to 18000
+long fixedAtan2(long y, long x);
+long fixedAcos(long cosine);
+
+// Integer square root, rounded down
+uint16_t fixedSqrt(uint32_t value);
+
+#endif
@@ -0,0 +1,101 @@
+#include "MotionProfile.h"
+
+// Easing tables, filled in at compile time from the profile formulas
+// through an index pack, so the AVR only does a lookup and a linear
+// interpolation
+static const int PROFILE_POINTS = 65;
+
+template <int... I>
+struct IndexList {};
+
+template <int N, int... I>
+struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> {};
+
+template <int... I>
+struct MakeIndexList<0, I...> {
+    typedef IndexList<I...> type;
+};
+
+// Accelerates over the first quarter, cruises at 4/3 of the linear
+// speed, then decelerates over the last quarter
+constexpr double trapezoid(double u) {
+    return u < 0.25 ? u * u * 8.0 / 3.0 :
+           u < 0.75 ? (u - 0.125) * 4.0 / 3.0 :
+           1.0 - (1.0 - u) * (1.0 - u) * 8.0 / 3.0;
+}
+
+// 10u^3 - 15u^4 + 6u^5, zero speed and acceleration at both ends
+constexpr double sCurve(double u) {
+    return u * u * u * (10.0 + u * (-15.0 + u * 6.0));
+}
+
+constexpr uint16_t toTableEntry(double s) {
+    return (uint16_t)(s * PROFILE_ONE + 0.5);
+}
+
+constexpr double tablePoint(int i) {
+    return (double)i / (PROFILE_POINTS - 1);
+}
+
+template <typename Indices>
+struct ProfileTables;
+
+template <int... I>
+struct ProfileTables<IndexList<I...> > {
+    static const uint16_t trapezoid[sizeof...(I)];
+    static const uint16_t sCurve[sizeof...(I)];
+};
+
+template <int... I>
+const uint16_t ProfileTables<IndexList<I...> >::trapezoid[sizeof...(I)] PROGMEM = {
+    toTableEntry(::trapezoid(tablePoint(I)))...
+};
+
+template <int... I>
+const uint16_t ProfileTables<IndexList<I...> >::sCurve[sizeof...(I)] PROGMEM = {
+    toTableEntry(::sCurve(tablePoint(I)))...
+};
+
+typedef ProfileTables<MakeIndexList<PROFILE_POINTS>::type> Tables;
+
+static uint16_t interpolate(const uint16_t* table, uint16_t time) {
+    if (time >= PROFILE_ONE) return PROFILE_ONE;
+    uint32_t position = (uint32_t)time * (PROFILE_POINTS - 1);
+    uint8_t index = position >> 14;
+    uint16_t fraction = position & (PROFILE_ONE - 1);
+    uint16_t value = pgm_read_word(&table[index]);
+    uint16_t next = pgm_read_word(&table[index + 1]);
+    return value + (((uint32_t)(next - value) * fraction) >> 14);
+}
+
+uint16_t profilePosition(ProfileType type, uint16_t time) {
+    switch (type) {
+        case PROFILE_TRAPEZOID: return interpolate(Tables::trapezoid, time);
+        case PROFILE_SCURVE: return interpolate(Tables::sCurve, time);
+        default: return min(time, PROFILE_ONE);
+    }
+}
+
+uint16_t profilePeakSpeed(ProfileType type) {
+    switch (type) {
+        case PROFILE_TRAPEZOID: return 341; // 4/3
+        case PROFILE_SCURVE: return 480;    // 15/8
+        default: return 256;
+    }
+}
+
+uint16_t profilePeakAcceleration(ProfileType type) {
+    switch (type) {
+        case PROFILE_TRAPEZOID: return 1366; // 16/3
+        case PROFILE_SCURVE: return 1478;    // 10/sqrt(3)
+        default: return 0;
+    }
+}
+
+const char* profileName(ProfileType type) {
+    switch (type) {
+        case PROFILE_TRAPEZOID: return "trapezoid";
+        case PROFILE_SCURVE: return "s-curve";
+        default: return "linear";
+    }
+}
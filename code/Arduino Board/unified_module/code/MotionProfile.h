@@ -0,0 +1,25 @@
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+#include <Arduino.h>
+
+enum ProfileType {
+    PROFILE_LINEAR,    // Constant speed, starts and stops abruptly
+    PROFILE_TRAPEZOID, // Constant acceleration over the first and last quarter
+    PROFILE_SCURVE     // Minimum jerk, acceleration eases in and out too
+};
+
+// Move and time fractions are Q14 fixed point (16384 is the whole move)
+const uint16_t PROFILE_ONE = 16384;
+
+// Fraction of the move covered once a fraction of its time has passed
+uint16_t profilePosition(ProfileType type, uint16_t time);
+
+// Peak speed and acceleration relative to a linear move over the same
+// distance and time, Q8. A linear move has no acceleration limit, 0
+uint16_t profilePeakSpeed(ProfileType type);
+uint16_t profilePeakAcceleration(ProfileType type);
+
+const char* profileName(ProfileType type);
+
+#endif
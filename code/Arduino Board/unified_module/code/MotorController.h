@@ -2,25 +2,212 @@
 #define MOTOR_CONTROLLER_H
 
 #include <Arduino.h>
+#include <EEPROM.h>
+#include "CurrentMonitor.h"
+#include "PinChange.h"
+
+enum StopMode {
+    STOP_RAMP,  // Ramp down at the deceleration limit, then coast
+    STOP_COAST, // Cut the drive at once and let the motors spin down
+    STOP_BRAKE  // Short the windings through the bridge, then coast
+};
+
+enum MotionBound {
+    BOUND_NONE,
+    BOUND_TIME,     // ms
+    BOUND_DISTANCE, // mm, mean travel of the two wheels
+    BOUND_ANGLE     // degrees of heading change
+};
+
+enum Wheel {
+    WHEEL_LEFT,
+    WHEEL_RIGHT
+};
+
+// Maps a commanded PWM onto what one motor needs to match the other
+struct MotorTrim {
+    int8_t offset;    // PWM added to every non-zero command
+    uint16_t gain;    // Q8, 256 is unity
+    uint8_t deadband; // PWM below which the motor doesn't turn
+};
+
+struct WheelTelemetry {
+    int setpoint;  // ticks/s
+    int measured;  // ticks/s, signed by the drive direction
+    int pwm;       // Signed output of the speed loop
+    int peakError; // Largest |setpoint - measured| since the last clear
+};
 
 class MotorController {
   private:
     uint8_t in1Pin, in2Pin, in3Pin, in4Pin;
     uint8_t enAPin, enBPin;
     int currentSpeed;
+    int speedLimit;
+
+    // Signed command per wheel, positive is forward: PWM, or ticks/s
+    // with the speed loop on. update() slews the outputs toward the
+    // targets set by the motion methods
+    int leftTarget, rightTarget;
+    int leftOutput, rightOutput;
+    unsigned int accelRate; // PWM counts/s, 0 for no limit
+    unsigned int decelRate; // PWM counts/s, 0 for no limit
+    unsigned long lastRampTime;
+    const unsigned long RAMP_INTERVAL = 10; // ms per ramp step
+    const unsigned long MAX_RAMP_TICKS = 100;
+
+    // Optional wheel encoders, counted by pin interrupts. Counters are
+    // static, so only one controller can own encoders
+    static volatile uint8_t* encoderInput[2];
+    static uint8_t encoderMask[2];
+    static volatile uint8_t encoderLevel[2];
+    static volatile uint16_t encoderTicks[2];
+    bool encodersAttached;
+    uint16_t encoderRead[2]; // Counters at the last read
+    uint16_t ticksSinceControl[2];
+
+    // Signed distance each wheel has covered, from the encoders or
+    // else from a time x PWM model
+    long encoderCount[2];
+    uint16_t umPerTick;
+    long modelTravel[2];     // um
+    uint16_t modelFullSpeed; // mm/s at full PWM
+    uint8_t modelDeadband;   // PWM below which the wheels don't turn
+    unsigned long lastTravelTime;
+    uint16_t trackWidth; // mm between the wheel contact points
+
+    // Motion that stops itself once its bound is reached
+    MotionBound bound;
+    unsigned long boundTarget; // ms or um
+    unsigned long boundStartTime;
+    long boundStartLeft, boundStartRight;
+    bool motionDone;
+
+    // Active braking, both bridge inputs high at full enable
+    bool braking;
+    unsigned long brakeStart;
+    unsigned int brakeTime; // ms before releasing to coast
+    int8_t wheelDirection[2]; // Last driven direction, signs encoder ticks
+
+    // Output calibration between the commands and the bridge, kept in
+    // EEPROM past RobotArm's saved positions
+    MotorTrim trim[2];
+    bool batteryAttached;
+    uint8_t batteryPin;
+    uint16_t batteryFullScale; // mV at an ADC reading of 1023
+    uint16_t batteryVoltage;   // mV, filtered
+    uint16_t nominalVoltage;   // mV the trim was set at, 0 for no compensation
+    uint16_t batteryScale;     // Q8 PWM scale making up for battery sag
+    unsigned long lastBatteryTime;
+    const unsigned long BATTERY_INTERVAL = 100; // ms between battery reads
+    static const int CALIBRATION_ADDRESS = 64;
+    static const uint8_t CALIBRATION_MAGIC = 0xC5;
+
+    // Optional motor current, through a shunt on the bridge's sense pins
+    CurrentMonitor currentMonitor;
+    bool currentAttached;
+    uint8_t currentPin;
+    uint16_t currentFullScale; // mA at an ADC reading of 1023
+    unsigned long lastCurrentTime;
+    uint8_t stallCount;
+    unsigned int stallBackoff; // ms reversing away from a stall
+    const unsigned long CURRENT_INTERVAL = 10; // ms between current samples
+
+    // PI speed loop per wheel, gains Q8 fixed point
+    struct SpeedLoop {
+        int measured;
+        int pwm;
+        long integral; // PWM, Q8
+        int peakError;
+    };
+    SpeedLoop speedLoop[2];
+    bool closedLoop;
+    int feedForward; // PWM per tick/s
+    int kp;          // PWM per tick/s of error
+    int ki;          // PWM per tick of accumulated error
+    unsigned long lastControlTime;
+    const unsigned long CONTROL_INTERVAL = 100; // ms per speed loop pass
+
+    int rampToward(int output, int target, unsigned long ticks);
+    void readEncoders();
+    void integrateModel();
+    void checkBound();
+    long brakingTravel(Wheel wheel);
+    void applyWheelSpeeds(int left, int right);
+    void updateSpeedLoop();
+    void runSpeedLoop(SpeedLoop& wheel, int setpoint, unsigned int ticks, unsigned long dt);
+    void resetSpeedLoop();
+    void writeChannel(uint8_t inA, uint8_t inB, uint8_t en, int output);
+    void releaseBrake();
+    int calibrate(Wheel wheel, int output);
+    void driveLeft(int output);
+    void driveRight(int output);
+    bool readBattery();
+    bool updateBatteryScale();
+    void handleStall();
+    void refreshOutputs();
+
+  protected:
+    // Hardware output of one wheel, overridden by FastMotorController
+    virtual void writeLeft(int output);
+    virtual void writeRight(int output);
+    virtual void writeBrake();
     
   public:
     MotorController(uint8_t in1, uint8_t in2, uint8_t in3, uint8_t in4, uint8_t enA, uint8_t enB);
     void begin();
+    void update();
+    void setWheelSpeeds(int left, int right);
+    void arc(int speed, int radiusMm);
     void moveForward();
     void moveBackward();
     void turnLeft();
     void turnRight();
     void rotateLeft();
     void rotateRight();
-    void stop();
+    void stop(StopMode mode = STOP_RAMP);
+    void emergencyStop();
+    void setBrakeTime(unsigned int ms);
+    bool isBraking();
     void setSpeed(int speed);
     int getSpeed();
+    void setSpeedLimit(int limit);
+    void clearSpeedLimit();
+    int getSpeedLimit();
+    void setRamp(unsigned int accel, unsigned int decel);
+    bool isRamping();
+    int getLeftOutput();
+    int getRightOutput();
+    bool attachEncoders(uint8_t leftPin, uint8_t rightPin);
+    bool setClosedLoop(bool enabled);
+    bool isClosedLoop();
+    void setSpeedGains(int feedForwardQ8, int kpQ8, int kiQ8);
+    WheelTelemetry getTelemetry(Wheel wheel);
+    void clearPeakErrors();
+    int getAppliedPwm(Wheel wheel);
+    void setTickDistance(uint16_t um);
+    void setPwmModel(uint16_t mmPerSec, uint8_t deadband);
+    long getWheelTravel(Wheel wheel);
+    void setTrackWidth(uint16_t mm);
+    uint16_t getTrackWidth();
+    void limitMotion(MotionBound type, unsigned long amount);
+    bool isBounded();
+    bool motionCompleted();
+    void setTrim(Wheel wheel, int8_t offset, uint16_t gainQ8, uint8_t deadband);
+    MotorTrim getTrim(Wheel wheel);
+    void attachBattery(uint8_t pin, uint16_t fullScaleMv);
+    uint16_t getBatteryVoltage();
+    void setNominalVoltage(uint16_t mv);
+    uint16_t getNominalVoltage();
+    void saveCalibration();
+    bool loadCalibration();
+    void resetCalibration();
+    void attachCurrentSense(uint8_t pin, uint16_t fullScaleMa);
+    void setStallLimits(uint16_t stallMa, unsigned int stallMs, uint16_t peakMa);
+    void setStallBackoff(unsigned int ms);
+    uint16_t getCurrent();
+    uint8_t getStallCount();
+    static void pollEncoders(); // Called from the pin interrupts
 };
 
 #endif
\ No newline at end of file
@@ -1,13 +1,50 @@
 #include "ObstacleAvoidance.h"
 
+// Escape sequences, each phase holds its motion for the given time
+static const ManeuverPhase CHECK_CRITICAL[] = {
+    {MANEUVER_STOP, 100}, {MANEUVER_BACKWARD, 500}, {MANEUVER_ROTATE, 750}, {MANEUVER_STOP, 0}
+};
+static const ManeuverPhase CHECK_STOP[] = {
+    {MANEUVER_STOP, 100}, {MANEUVER_ROTATE, 500}, {MANEUVER_STOP, 0}
+};
+static const ManeuverPhase NAV_CRITICAL[] = {
+    {MANEUVER_STOP, 100}, {MANEUVER_BACKWARD, 1000}, {MANEUVER_ROTATE, 750}
+};
+static const ManeuverPhase NAV_STOP[] = {
+    {MANEUVER_STOP, 100}, {MANEUVER_ROTATE, 500}
+};
+
 ObstacleAvoidance::ObstacleAvoidance(MotorController* m, UltrasonicSensor* s) {
     motors = m;
     sensor = s;
+    sideSensors = nullptr;
     isEnabled = false;
-    stopDistance = 30.0;  // Stop if obstacle is closer than 30cm
-    turnDistance = 50.0;  // Start turning if obstacle is closer than 50cm
-    criticalDistance = 15.0; // Emergency stop and back up if closer than 15cm
+    navigating = false;
+    stopDistance = 300;  // Stop if obstacle is closer than 30cm
+    turnDistance = 500;  // Start turning if obstacle is closer than 50cm
+    criticalDistance = 150; // Emergency stop and back up if closer than 15cm
+    slowDistance = 800;  // Slow down if obstacle is closer than 80cm (TTC mode)
+    mode = AVOID_FIXED;
+    slowTime = 2500;
+    turnTime = 1200;
+    stopTime = 600;
+    closingSpeed = 0;
+    lastRangeMm = 0;
+    lastRangeTime = 0;
+    approachZone = ZONE_CLEAR;
+    zoneSince = 0;
     lastCheckTime = 0;
+    phaseCount = 0;
+    phaseIndex = 0;
+    phaseStart = 0;
+    scanOnStop = false;
+    awaitingHeading = false;
+    headingRequestTime = 0;
+    headingTimeout = 5000;
+    turnRate = 120;
+    escapeLeft = false;
+    seenStalls = 0;
+    clearStats();
 }
 
 void ObstacleAvoidance::begin() {
@@ -16,51 +53,341 @@ void ObstacleAvoidance::begin() {
 
 void ObstacleAvoidance::enable() {
     isEnabled = true;
+    seenStalls = motors->getStallCount();
 }
 
 void ObstacleAvoidance::disable() {
     isEnabled = false;
+    if (navigating) {
+        stopNavigation();
+    }
+    else if (isManeuvering()) {
+        abortManeuver();
+    }
 }
 
 bool ObstacleAvoidance::isActive() {
     return isEnabled;
 }
 
-void ObstacleAvoidance::setDistances(float stop, float turn, float critical) {
-    stopDistance = stop;
-    turnDistance = turn;
-    criticalDistance = critical;
+void ObstacleAvoidance::startNavigation() {
+    isEnabled = true;
+    navigating = true;
+    seenStalls = motors->getStallCount();
+}
+
+void ObstacleAvoidance::stopNavigation() {
+    // Avoidance stays enabled, as it did after the old blocking loop
+    navigating = false;
+    awaitingHeading = false;
+    abortManeuver();
+    motors->clearSpeedLimit();
+}
+
+bool ObstacleAvoidance::isNavigating() {
+    return navigating;
+}
+
+void ObstacleAvoidance::update() {
+    // One non-blocking step of whichever behavior is active
+    if (navigating) {
+        navigate();
+    }
+    else if (isEnabled) {
+        check();
+    }
+}
+
+void ObstacleAvoidance::setDistances(uint16_t stopMm, uint16_t turnMm, uint16_t criticalMm) {
+    stopDistance = stopMm;
+    turnDistance = turnMm;
+    criticalDistance = criticalMm;
+}
+
+// Derives the thresholds from a measured stopping distance: the
+// critical zone still leaves room to brake, and each milder zone adds
+// room to react. A 100mm stop gives the defaults
+void ObstacleAvoidance::setStoppingDistance(uint16_t stoppingMm) {
+    criticalDistance = stoppingMm + 50;
+    stopDistance = criticalDistance + 150;
+    turnDistance = stopDistance + 200;
+}
+
+void ObstacleAvoidance::setSensorArray(UltrasonicArray* array) {
+    sideSensors = array;
+}
+
+void ObstacleAvoidance::setMode(AvoidanceMode m) {
+    mode = m;
+    motors->clearSpeedLimit();
+}
+
+AvoidanceMode ObstacleAvoidance::getMode() {
+    return mode;
+}
+
+void ObstacleAvoidance::setSlowDistance(uint16_t slowMm) {
+    slowDistance = slowMm;
+}
+
+void ObstacleAvoidance::setTimeToCollision(unsigned int slowMs, unsigned int turnMs, unsigned int stopMs) {
+    slowTime = slowMs;
+    turnTime = turnMs;
+    stopTime = stopMs;
+}
+
+void ObstacleAvoidance::trackClosingSpeed() {
+    RangeReading reading = sensor->getReading();
+    if (reading.status != RANGE_VALID || reading.timestamp == lastRangeTime) return;
+    updateClosingSpeed(reading.distanceMm, reading.timestamp);
+}
+
+// Feeds one range sample into the closing speed estimate
+void ObstacleAvoidance::updateClosingSpeed(uint16_t distanceMm, unsigned long timestamp) {
+    unsigned long dt = timestamp - lastRangeTime;
+    if (lastRangeTime == 0 || dt == 0 || dt > MAX_RANGE_GAP) {
+        closingSpeed = 0;
+    }
+    else {
+        long speed = ((long)lastRangeMm - (long)distanceMm) * 1000L / (long)dt;
+        speed = constrain(speed, -5000L, 5000L);
+        // Light smoothing, single samples are noisy at 50ms spacing
+        closingSpeed += (int)((speed - closingSpeed) / 4);
+    }
+    lastRangeMm = distanceMm;
+    lastRangeTime = timestamp;
+}
+
+int ObstacleAvoidance::getClosingSpeed() {
+    return closingSpeed;
+}
+
+unsigned long ObstacleAvoidance::getTimeToCollision(uint16_t distanceMm) {
+    if (closingSpeed < MIN_CLOSING_SPEED) return 0xFFFFFFFFUL;
+
+    // Judge the approach at the commanded speed, not the slowed one,
+    // so slowing down does not by itself clear the slow zone
+    long speed = motors->getSpeed();
+    long applied = min(speed, (long)motors->getSpeedLimit());
+    long closing = closingSpeed;
+    if (applied > 0) closing = closing * speed / applied;
+    return (unsigned long)distanceMm * 1000UL / closing;
+}
+
+uint16_t ObstacleAvoidance::scaledDistance(uint16_t base) {
+    if (mode == AVOID_FIXED) return base;
+    // Envelopes grow with speed, but never below a quarter of the base
+    uint32_t scaled = (uint32_t)base * motors->getSpeed() / REFERENCE_SPEED;
+    return max(scaled, (uint32_t)(base / 4));
+}
+
+ApproachZone ObstacleAvoidance::classify(uint16_t distance) {
+    if (distance <= scaledDistance(criticalDistance)) return ZONE_CRITICAL;
+
+    if (mode == AVOID_FIXED) {
+        if (distance <= stopDistance) return ZONE_STOP;
+        if (distance <= turnDistance) return ZONE_TURN;
+        return ZONE_CLEAR;
+    }
+
+    unsigned long ttc = getTimeToCollision(distance);
+    ApproachZone zone = ZONE_CLEAR;
+    if (distance <= scaledDistance(stopDistance) || ttc <= stopTime) zone = ZONE_STOP;
+    else if (distance <= scaledDistance(turnDistance) || ttc <= turnTime) zone = ZONE_TURN;
+    else if (distance <= scaledDistance(slowDistance) || ttc <= slowTime) zone = ZONE_SLOW;
+
+    // Turning and slowing lower the closing speed themselves, so hold
+    // a zone for a moment before easing off to keep from chattering
+    unsigned long now = millis();
+    if (zone >= approachZone || now - zoneSince >= ZONE_HOLD_TIME) {
+        approachZone = zone;
+        zoneSince = now;
+    }
+    return approachZone;
+}
+
+void ObstacleAvoidance::turnAway() {
+    if (sideSensors != nullptr && sideSensors->getClearestSide() == SENSOR_LEFT) {
+        motors->turnLeft();
+    }
+    else {
+        motors->turnRight();
+    }
+}
+
+void ObstacleAvoidance::startManeuver(const ManeuverPhase* sequence, int count) {
+    // Rotating changes what the sensor sees, so restart the estimate
+    lastRangeTime = 0;
+    closingSpeed = 0;
+    approachZone = ZONE_CLEAR;
+    motors->clearSpeedLimit();
+
+    phaseCount = min(count, MAX_PHASES);
+    for (int i = 0; i < phaseCount; i++) {
+        phases[i] = sequence[i];
+    }
+    phaseIndex = 0;
+    applyPhase();
+}
+
+void ObstacleAvoidance::applyPhase() {
+    phaseStart = millis();
+    switch (phases[phaseIndex].action) {
+        case MANEUVER_STOP:
+            // An emergency stop may have just braked; stopping again
+            // would let go of the brake and coast instead
+            if (!motors->isBraking()) motors->stop();
+            break;
+        case MANEUVER_BACKWARD: motors->moveBackward(); break;
+        case MANEUVER_ROTATE:
+            if (escapeLeft) motors->rotateLeft();
+            else motors->rotateRight();
+            break;
+        case MANEUVER_ROTATE_LEFT: motors->rotateLeft(); break;
+        case MANEUVER_ROTATE_RIGHT: motors->rotateRight(); break;
+    }
+}
+
+void ObstacleAvoidance::updateManeuver() {
+    // Step through every phase whose time is up, so zero-length
+    // phases complete in the same call
+    while (phaseIndex < phaseCount && millis() - phaseStart >= phases[phaseIndex].duration) {
+        // A stop followed by more motion holds until the brake lets go,
+        // however long brakeTime is, or the robot reverses still rolling
+        if (phases[phaseIndex].action == MANEUVER_STOP && phaseIndex + 1 < phaseCount && motors->isBraking()) {
+            break;
+        }
+        phaseIndex++;
+        if (phaseIndex < phaseCount) applyPhase();
+        else lastEscapeEnd = millis();
+    }
+}
+
+// Starts an escape, escalated when it follows the last one too closely
+void ObstacleAvoidance::startEscape(const ManeuverPhase* sequence, int count) {
+    unsigned long now = millis();
+    // Without side sensors there is nothing to choose from
+    bool preferLeft = sideSensors != nullptr && sideSensors->getClearestSide() == SENSOR_LEFT;
+
+    if (episodeActive && now - lastEscapeEnd < ESCAPE_WINDOW) {
+        // Blocked again right after escaping, so the last escape failed
+        if (escalation < MAX_ESCALATION) escalation++;
+    }
+    else {
+        episodeActive = true;
+        episodeStart = now;
+        escalation = 0;
+        episodeFirstLeft = preferLeft;
+    }
+
+    // A repeat mostly means the last turn fell short, so level 1 turns
+    // the same way for longer; reversing would undo the turn so far. From
+    // level 2 on keep to the side the episode did not start on, as
+    // following the clearer side is what ping-pongs in a corner
+    if (escalation == 0) escapeLeft = preferLeft;
+    else escapeLeft = escalation == 1 ? episodeFirstLeft : !episodeFirstLeft;
+
+    // Escalated escapes rotate twice as long, level 3 also backs out further
+    ManeuverPhase escalated[MAX_PHASES];
+    int n = 0;
+    bool backedUp = false;
+    for (int i = 0; i < count && n < MAX_PHASES; i++) {
+        ManeuverPhase phase = sequence[i];
+        if (phase.action == MANEUVER_BACKWARD) {
+            if (escalation >= 3) phase.duration = max(phase.duration, ESCALATED_BACKUP);
+            backedUp = true;
+        }
+        else if (phase.action == MANEUVER_ROTATE) {
+            if (escalation >= 3 && !backedUp && n < MAX_PHASES - 1) {
+                escalated[n++] = {MANEUVER_BACKWARD, ESCALATED_BACKUP};
+                backedUp = true;
+            }
+            if (escalation >= 1) phase.duration *= 2;
+        }
+        escalated[n++] = phase;
+    }
+
+    history[historyHead] = {now, escapeLeft, escalation, false};
+    historyHead = (historyHead + 1) % HISTORY_SIZE;
+    if (historyCount < HISTORY_SIZE) historyCount++;
+
+    startManeuver(escalated, n);
+}
+
+// Closes the episode once a full window passes without another escape
+void ObstacleAvoidance::trackEpisode() {
+    if (!episodeActive || awaitingHeading) return;
+    if (millis() - lastEscapeEnd < ESCAPE_WINDOW) return;
+
+    lastTimeToClear = lastEscapeEnd - episodeStart;
+    maxTimeToClear = max(maxTimeToClear, lastTimeToClear);
+    episodeCount++;
+    history[(historyHead + HISTORY_SIZE - 1) % HISTORY_SIZE].cleared = true;
+    episodeActive = false;
+    escalation = 0;
+}
+
+// True once for each stall since the last call
+bool ObstacleAvoidance::newStall() {
+    uint8_t stalls = motors->getStallCount();
+    if (stalls == seenStalls) return false;
+    seenStalls = stalls;
+    return true;
+}
+
+bool ObstacleAvoidance::isManeuvering() {
+    return phaseIndex < phaseCount;
+}
+
+void ObstacleAvoidance::abortManeuver() {
+    phaseIndex = phaseCount;
+    motors->stop();
+    // An interrupted episode has no time to clear
+    episodeActive = false;
+    escalation = 0;
 }
 
 bool ObstacleAvoidance::check() {
     if (!isEnabled) return true;
+
+    // A stall during an escape is left to the motors' own back-off
+    bool stalled = newStall();
+    if (isManeuvering()) {
+        updateManeuver();
+        return false;
+    }
+    if (stalled) {
+        startEscape(CHECK_CRITICAL, sizeof(CHECK_CRITICAL) / sizeof(CHECK_CRITICAL[0]));
+        return false;
+    }
+
+    trackEpisode();
+    trackClosingSpeed();
     
     unsigned long currentTime = millis();
     if (currentTime - lastCheckTime >= CHECK_INTERVAL) {
-        float distance = sensor->getFilteredDistance(3);
+        uint16_t distance = sensor->getFilteredDistanceMm(3);
         lastCheckTime = currentTime;
+
+        // Missing or out-of-range echoes are not obstacles, but an echo
+        // inside the blind zone is something touching the sensor
+        RangeStatus status = sensor->getReading().status;
+        if (status == RANGE_TOO_CLOSE) distance = 0;
+        else if (status != RANGE_VALID) return true;
         
-        if (distance <= criticalDistance) {
-            motors->stop();
-            delay(100);
-            motors->moveBackward();
-            delay(500);
-            motors->rotateRight();
-            delay(750);
-            motors->stop();
-            return false;
-        }
-        else if (distance <= stopDistance) {
-            motors->stop();
-            delay(100);
-            motors->rotateRight();
-            delay(500);
-            motors->stop();
-            return false;
-        }
-        else if (distance <= turnDistance) {
-            motors->turnRight();
-            return true;
+        switch (classify(distance)) {
+            case ZONE_CRITICAL:
+                motors->emergencyStop();
+                startEscape(CHECK_CRITICAL, sizeof(CHECK_CRITICAL) / sizeof(CHECK_CRITICAL[0]));
+                return false;
+            case ZONE_STOP:
+                startEscape(CHECK_STOP, sizeof(CHECK_STOP) / sizeof(CHECK_STOP[0]));
+                return false;
+            case ZONE_TURN:
+                turnAway();
+                return true;
+            default:
+                break;
         }
     }
     return true;
@@ -68,30 +395,150 @@ bool ObstacleAvoidance::check() {
 
 void ObstacleAvoidance::navigate() {
     if (!isEnabled) return;
+
+    bool stalled = newStall();
+    if (isManeuvering()) {
+        updateManeuver();
+        return;
+    }
+    if (stalled) {
+        awaitingHeading = false;
+        startEscape(NAV_CRITICAL, sizeof(NAV_CRITICAL) / sizeof(NAV_CRITICAL[0]));
+        return;
+    }
+
+    if (awaitingHeading) {
+        // Stay stopped until a heading arrives, or give up on it
+        if (millis() - headingRequestTime >= headingTimeout) {
+            awaitingHeading = false;
+            startEscape(NAV_STOP, sizeof(NAV_STOP) / sizeof(NAV_STOP[0]));
+        }
+        return;
+    }
+
+    trackEpisode();
+    trackClosingSpeed();
     
-    float distance = sensor->getFilteredDistance(3);
-    
-    if (distance <= criticalDistance) {
-        // Emergency maneuver
-        motors->stop();
-        delay(100);
-        motors->moveBackward();
-        delay(1000);
-        motors->rotateRight();
-        delay(750);
-    }
-    else if (distance <= stopDistance) {
-        // Find new path
-        motors->stop();
-        delay(100);
-        motors->rotateRight();
-        delay(500);
-    }
-    else if (distance <= turnDistance) {
-        // Gentle turn
-        motors->turnRight();
+    uint16_t distance = sensor->getFilteredDistanceMm(3);
+
+    RangeStatus status = sensor->getReading().status;
+    if (status == RANGE_TOO_CLOSE) {
+        // Inside the blind zone, as close as an obstacle gets
+        distance = 0;
     }
-    else {
-        motors->moveForward();
+    else if (status != RANGE_VALID) {
+        // Nothing within range means the path ahead is clear; a missing
+        // echo is ignored and the current motion is kept
+        if (status == RANGE_OUT_OF_RANGE) {
+            motors->clearSpeedLimit();
+            motors->moveForward();
+        }
+        return;
     }
-}
\ No newline at end of file
+    
+    switch (classify(distance)) {
+        case ZONE_CRITICAL:
+            // Emergency maneuver, no time to ramp down
+            motors->emergencyStop();
+            startEscape(NAV_CRITICAL, sizeof(NAV_CRITICAL) / sizeof(NAV_CRITICAL[0]));
+            break;
+        case ZONE_STOP:
+            // Find new path, by scan if one is set up
+            if (scanOnStop) {
+                motors->clearSpeedLimit();
+                motors->stop();
+                awaitingHeading = true;
+                headingRequestTime = millis();
+            }
+            else {
+                startEscape(NAV_STOP, sizeof(NAV_STOP) / sizeof(NAV_STOP[0]));
+            }
+            break;
+        case ZONE_TURN:
+            // Gentle turn, at reduced speed when in TTC mode
+            if (mode == AVOID_TTC) {
+                motors->setSpeedLimit(motors->getSpeed() / 2);
+            }
+            turnAway();
+            break;
+        case ZONE_SLOW:
+            // Approaching, keep going at half speed
+            motors->setSpeedLimit(motors->getSpeed() / 2);
+            motors->moveForward();
+            break;
+        case ZONE_CLEAR:
+            motors->clearSpeedLimit();
+            motors->moveForward();
+            break;
+    }
+}
+
+void ObstacleAvoidance::setScanOnStop(bool enabled) {
+    scanOnStop = enabled;
+    if (!enabled) awaitingHeading = false;
+}
+
+bool ObstacleAvoidance::isAwaitingHeading() {
+    return awaitingHeading;
+}
+
+// Long enough for whatever answers the heading request, such as a scan
+void ObstacleAvoidance::setHeadingTimeout(unsigned long ms) {
+    headingTimeout = ms;
+}
+
+void ObstacleAvoidance::setTurnRate(unsigned int degPerSec) {
+    turnRate = max(degPerSec, 1u);
+}
+
+// Rotates in place by heading degrees, positive to the left
+void ObstacleAvoidance::steerTo(int heading) {
+    awaitingHeading = false;
+
+    int speed = max(motors->getSpeed(), 1);
+    unsigned long duration = (unsigned long)abs(heading) * 1000UL * REFERENCE_SPEED / ((unsigned long)turnRate * speed);
+    ManeuverPhase sequence[] = {
+        {heading > 0 ? MANEUVER_ROTATE_LEFT : MANEUVER_ROTATE_RIGHT, (unsigned int)min(duration, 10000UL)},
+        {MANEUVER_STOP, 0}
+    };
+    startManeuver(sequence, 2);
+}
+
+uint8_t ObstacleAvoidance::getEscalation() {
+    return escalation;
+}
+
+unsigned int ObstacleAvoidance::getEpisodeCount() {
+    return episodeCount;
+}
+
+unsigned long ObstacleAvoidance::getLastTimeToClear() {
+    return lastTimeToClear;
+}
+
+unsigned long ObstacleAvoidance::getMaxTimeToClear() {
+    return maxTimeToClear;
+}
+
+int ObstacleAvoidance::getHistoryCount() {
+    return historyCount;
+}
+
+// Index 0 is the most recent escape
+EscapeRecord ObstacleAvoidance::getHistory(int index) {
+    index = constrain(index, 0, max(historyCount - 1, 0));
+    return history[(historyHead + HISTORY_SIZE - 1 - index) % HISTORY_SIZE];
+}
+
+void ObstacleAvoidance::clearStats() {
+    historyHead = 0;
+    historyCount = 0;
+    escalation = 0;
+    episodeActive = false;
+    episodeFirstLeft = false;
+    episodeStart = 0;
+    lastEscapeEnd = 0;
+    episodeCount = 0;
+    lastTimeToClear = 0;
+    maxTimeToClear = 0;
+}
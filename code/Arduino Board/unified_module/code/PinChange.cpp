@@ -0,0 +1,55 @@
+#include "PinChange.h"
+
+PinChange::Handler PinChange::handlers[MAX_HANDLERS];
+volatile uint8_t PinChange::handlerCount = 0;
+uint8_t PinChange::claimedGroups = 0;
+
+// Runs from the static initializer PIN_CHANGE_ISR() sets up
+bool PinChange::claim(uint8_t group) {
+    claimedGroups |= 1 << group;
+    return true;
+}
+
+// Calls function on every change of any pin in the pin's group, so the
+// function has to check its own pin. Fails when the pin has no pin
+// change interrupt or the sketch has not claimed its group
+bool PinChange::attach(uint8_t pin, void (*function)()) {
+#if defined(PCICR)
+    if (digitalPinToPCICR(pin) == nullptr) return false;
+    uint8_t group = digitalPinToPCICRbit(pin);
+    if (!(claimedGroups & (1 << group))) return false;
+
+    bool listed = false;
+    for (uint8_t i = 0; i < handlerCount; i++) {
+        if (handlers[i].group == group && handlers[i].function == function) listed = true;
+    }
+    if (!listed) {
+        if (handlerCount >= MAX_HANDLERS) return false;
+        // Filled in before it is counted, so the ISR never sees half of it
+        handlers[handlerCount] = {group, function};
+        handlerCount++;
+    }
+
+    *digitalPinToPCMSK(pin) |= 1 << digitalPinToPCMSKbit(pin);
+    PCICR |= 1 << group;
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Stops the pin's changes raising its group's interrupt. The handlers
+// stay listed for any other pins of the group
+void PinChange::detach(uint8_t pin) {
+#if defined(PCICR)
+    if (digitalPinToPCICR(pin) == nullptr) return;
+    *digitalPinToPCMSK(pin) &= ~(1 << digitalPinToPCMSKbit(pin));
+    if (*digitalPinToPCMSK(pin) == 0) PCICR &= ~(1 << digitalPinToPCICRbit(pin));
+#endif
+}
+
+void PinChange::dispatch(uint8_t group) {
+    for (uint8_t i = 0; i < handlerCount; i++) {
+        if (handlers[i].group == group) handlers[i].function();
+    }
+}
@@ -1,7 +1,9 @@
 // RobotArm.cpp
 #include "RobotArm.h"
+#include "FixedTrig.h"
 
-RobotArm::RobotArm(int bPin, int sPin, int ePin, int gPin) {
+RobotArm::RobotArm(int bPin, int sPin, int ePin, int gPin)
+  : kinematics(BASE_HEIGHT, UPPER_ARM, FOREARM) {
   basePin = bPin;
   shoulderPin = sPin;
   elbowPin = ePin;
@@ -11,6 +13,20 @@ RobotArm::RobotArm(int bPin, int sPin, int ePin, int gPin) {
   shoulderAngle = HOME_SHOULDER;
   elbowAngle = HOME_ELBOW;
   gripperAngle = HOME_GRIPPER;
+  for (int i = 0; i < 4; i++) {
+    jointSpeed[i] = 240;
+    jointAccel[i] = 600;
+  }
+  profile = PROFILE_SCURVE;
+  jogStep = 10;
+  jogValid = false;
+  queueHead = 0;
+  queueCount = 0;
+  segmentSteps = 0;
+  segmentStep = 0;
+  segmentProfile = profile;
+  lastFrame = 0;
+  motionDone = false;
 
   commandCount = 0;
   recording = false;
@@ -23,19 +39,132 @@ void RobotArm::begin() {
   gripperServo.attach(gripperPin);
 
   loadPositionsFromEEPROM();
+  lastFrame = TimerServo::getFrameCount();
   moveToHome();
 }
 
+// Advances the queued moves by the servo frames that passed since the
+// last call, so each servo is written once per frame. Call every loop
+void RobotArm::update() {
+  uint8_t frame = TimerServo::getFrameCount();
+  uint8_t frames = frame - lastFrame;
+  if (frames == 0) return;
+  lastFrame = frame;
+
+  if (segmentSteps == 0) {
+    if (queueCount == 0) return;
+    startSegment();
+    frames = 1;
+  }
+
+  // A late call catches up rather than slowing the move down
+  segmentStep = min(segmentStep + frames, segmentSteps);
+  uint16_t time = (uint32_t)segmentStep * PROFILE_ONE / segmentSteps;
+  uint16_t position = profilePosition(segmentProfile, time);
+  const Segment &segment = queue[queueHead];
+  for (int i = 0; i < 4; i++) {
+    int travel = segment.target[i] - segmentStart[i];
+    writeJoint(i, segmentStart[i] + (long)travel * position / PROFILE_ONE);
+  }
+
+  if (segmentStep == segmentSteps) {
+    queueHead = (queueHead + 1) % MAX_SEGMENTS;
+    queueCount--;
+    segmentSteps = 0;
+    if (queueCount == 0) motionDone = true;
+  }
+}
+
+// All joints share the profile and the duration, so the move takes as
+// long as the joint that needs longest to stay within its speed and
+// acceleration limits
+void RobotArm::startSegment() {
+  const Segment &segment = queue[queueHead];
+  segmentProfile = profile;
+  uint16_t peakSpeed = profilePeakSpeed(segmentProfile);
+  uint16_t peakAccel = profilePeakAcceleration(segmentProfile);
+
+  unsigned long duration = segment.duration;
+  for (int i = 0; i < 4; i++) {
+    segmentStart[i] = jointAngle(i);
+    unsigned long travel = abs(segment.target[i] - segmentStart[i]);
+    duration = max(duration, travel * peakSpeed * 1000UL / (256UL * jointSpeed[i]));
+    if (peakAccel > 0) {
+      // Peak acceleration is peakAccel / 256 * travel / T^2, so T in ms
+      // is sqrt(travel * peakAccel * 10^6 / 256 / jointAccel). 180 degrees
+      // at the S-curve's peak still fits 32 bits before the division
+      unsigned long accelTime = fixedSqrt(travel * peakAccel * 15625UL / (4UL * jointAccel[i]));
+      duration = max(duration, accelTime);
+    }
+  }
+
+  segmentSteps = max(duration / FRAME_TIME, 1UL);
+  segmentStep = 0;
+}
+
+// Stops where the arm is, dropping the queued moves
+void RobotArm::stop() {
+  queueCount = 0;
+  segmentSteps = 0;
+  motionDone = false;
+}
+
+// True once when the queue has run empty
+bool RobotArm::motionCompleted() {
+  if (!motionDone) return false;
+  motionDone = false;
+  return true;
+}
+
+int RobotArm::jointAngle(int joint) {
+  switch (joint) {
+    case 0: return baseAngle;
+    case 1: return shoulderAngle;
+    case 2: return elbowAngle;
+    default: return gripperAngle;
+  }
+}
+
+void RobotArm::writeJoint(int joint, int angle) {
+  switch (joint) {
+    case 0: baseAngle = angle; baseServo.write(angle); break;
+    case 1: shoulderAngle = angle; shoulderServo.write(angle); break;
+    case 2: elbowAngle = angle; elbowServo.write(angle); break;
+    default: gripperAngle = angle; gripperServo.write(angle); break;
+  }
+}
+
+// Pose the arm will have once everything queued has run
+void RobotArm::queuedPose(int pose[4]) {
+  for (int i = 0; i < 4; i++) {
+    if (queueCount == 0) pose[i] = jointAngle(i);
+    else pose[i] = queue[(queueHead + queueCount - 1) % MAX_SEGMENTS].target[i];
+  }
+}
+
 void RobotArm::moveJoint(char joint, char direction) {
+  int step;
+  int pose[4];
+  queuedPose(pose);
+  if (direction == '+') {
+    step = STEP_ANGLE;
+  }
+  else if (direction == '-') {
+    step = -STEP_ANGLE;
+  }
+  else {
+    return; // Invalid direction
+  }
+
   switch (joint) {
     case 'b':
-      moveServo(baseServo, direction, &baseAngle);
+      moveJoints(pose[0] + step, KEEP, KEEP, KEEP);
       break;
     case 's':
-      moveServo(shoulderServo, direction, &shoulderAngle);
+      moveJoints(KEEP, pose[1] + step, KEEP, KEEP);
       break;
     case 'e':
-      moveServo(elbowServo, direction, &elbowAngle);
+      moveJoints(KEEP, KEEP, pose[2] + step, KEEP);
       break;
   }
 }
@@ -54,98 +183,168 @@ void RobotArm::moveGripper(char action) {
     return;  // Invalid action
   }
 
-  // Use smooth movement for gripper
-  moveToAngle(gripperServo, &gripperAngle, targetAngle);
+  moveJoints(KEEP, KEEP, KEEP, targetAngle);
 }
 
-void RobotArm::moveServo(Servo &servo, char direction, int *currentAngle) {
-  int newAngle = *currentAngle;
-  int targetAngle;
+// Jumps the base straight to an angle without interpolation, so callers
+// such as the sweep scanner can pace the motion themselves. Takes over
+// from any queued moves
+void RobotArm::setBaseAngle(int angle) {
+  stop();
+  baseAngle = constrain(angle, MIN_ANGLE, MAX_ANGLE);
+  baseServo.write(baseAngle);
+}
+
+// Queues a move of all joints together, run by update() so they all
+// arrive at the same moment. The move takes durationMs, stretched where
+// a joint would have to turn or accelerate faster than its limits allow;
+// 0 moves as fast as they allow. Returns false when the queue is full
+bool RobotArm::moveJoints(int base, int shoulder, int elbow, int gripper, unsigned int durationMs) {
+  if (queueCount >= MAX_SEGMENTS) {
+    Serial.println("Arm queue full");
+    return false;
+  }
+
+  int pose[4];
+  queuedPose(pose);
+  int targets[4] = {base, shoulder, elbow, gripper};
+  Segment &segment = queue[(queueHead + queueCount) % MAX_SEGMENTS];
+  for (int i = 0; i < 4; i++) {
+    int target = targets[i] == KEEP ? pose[i] : targets[i];
+    segment.target[i] = constrain(target, MIN_ANGLE, MAX_ANGLE);
+  }
+  segment.duration = durationMs;
+  queueCount++;
+  return true;
+}
 
+// Queues a coordinated move of the gripper tip to a point, keeping the
+// gripper as it is. Returns false, leaving the arm alone, when the
+// point is out of reach or the queue is full
+bool RobotArm::moveTo(ArmPoint target, unsigned int durationMs) {
+  int angles[3];
+  ReachStatus status = kinematics.inverse(target, angles);
+  if (status != REACH_OK) {
+    Serial.println("Target out of reach: " + String(ArmKinematics::statusName(status)));
+    return false;
+  }
+  return moveJoints(angles[0], angles[1], angles[2], KEEP, durationMs);
+}
+
+// Where the gripper tip is now
+ArmPoint RobotArm::getPosition() {
+  return kinematics.forward(baseAngle, shoulderAngle, elbowAngle);
+}
+
+void RobotArm::setLinkLengths(int baseHeight, int upperArm, int forearm) {
+  kinematics.setLinks(baseHeight, upperArm, forearm);
+  jogValid = false;
+}
+
+// Moves the gripper tip jogStep mm along x, y or z from where the
+// queued moves leave it, as one coordinated move
+bool RobotArm::jog(char axis, char direction) {
+  int step;
   if (direction == '+') {
-    targetAngle = min(newAngle + STEP_ANGLE, MAX_ANGLE);
+    step = jogStep;
   }
   else if (direction == '-') {
-    targetAngle = max(newAngle - STEP_ANGLE, MIN_ANGLE);
+    step = -jogStep;
   }
   else {
-    return; // Invalid direction
+    return false; // Invalid direction
   }
 
-  // Smooth movement by gradually changing angle
-  if (targetAngle != *currentAngle) {
-    int increment = (targetAngle > *currentAngle) ? 1 : -1;
-    
-    while (*currentAngle != targetAngle) {
-      *currentAngle += increment;
-      servo.write(*currentAngle);
-      
-      // Adjust delay for smoother movement
-      // Lower delay = faster movement, higher delay = slower, smoother movement
-      delay(10);  // Reduced from previous 15ms 
-    }
+  int pose[4];
+  queuedPose(pose);
+  ArmPoint target;
+  if (jogValid && pose[0] == jogPose[0] && pose[1] == jogPose[1] && pose[2] == jogPose[2]) {
+    target = jogTarget;
+  }
+  else {
+    target = kinematics.forward(pose[0], pose[1], pose[2]);
+  }
+
+  switch (axis) {
+    case 'x': target.x += step; break;
+    case 'y': target.y += step; break;
+    case 'z': target.z += step; break;
+    default: return false;
   }
+
+  if (!moveTo(target)) return false;
+  queuedPose(pose);
+  for (int i = 0; i < 3; i++) jogPose[i] = pose[i];
+  jogTarget = target;
+  jogValid = true;
+  return true;
 }
 
-void RobotArm::moveToAngle(Servo &servo, int *currentAngle, int targetAngle) {
-  targetAngle = constrain(targetAngle, MIN_ANGLE, MAX_ANGLE);
-  
-  if (targetAngle != *currentAngle) {
-    int increment = (targetAngle > *currentAngle) ? 1 : -1;
-    
-    while (*currentAngle != targetAngle) {
-      *currentAngle += increment;
-      servo.write(*currentAngle);
-      
-      // Consistent smooth movement across all methods
-      delay(10);  // Same smooth movement delay as in moveServo
-    }
+void RobotArm::setJogStep(int mm) {
+  jogStep = constrain(mm, 1, 100);
+}
+
+// Holds the queued pose
+void RobotArm::wait(unsigned int ms) {
+  moveJoints(KEEP, KEEP, KEEP, KEEP, ms);
+}
+
+// Sets the speed limit of every joint
+void RobotArm::setMaxJointSpeed(int degPerSec) {
+  for (int i = 0; i < 4; i++) {
+    jointSpeed[i] = constrain(degPerSec, 10, 1000);
+  }
+}
+
+// Sets the acceleration limit of every joint
+void RobotArm::setMaxJointAccel(int degPerSec2) {
+  for (int i = 0; i < 4; i++) {
+    jointAccel[i] = constrain(degPerSec2, 50, 10000);
   }
 }
 
+// Joint 0-3 is base, shoulder, elbow, gripper. Takes effect from the
+// next move started
+void RobotArm::setJointLimits(int joint, int degPerSec, int degPerSec2) {
+  if (joint < 0 || joint > 3) return;
+  jointSpeed[joint] = constrain(degPerSec, 10, 1000);
+  jointAccel[joint] = constrain(degPerSec2, 50, 10000);
+}
+
 void RobotArm::moveToHome() {
-  moveToAngle(baseServo, &baseAngle, HOME_BASE);
-  moveToAngle(shoulderServo, &shoulderAngle, HOME_SHOULDER);
-  moveToAngle(elbowServo, &elbowAngle, HOME_ELBOW);
-  moveToAngle(gripperServo, &gripperAngle, HOME_GRIPPER);
-  Serial.println("Moved to home position");
+  moveJoints(HOME_BASE, HOME_SHOULDER, HOME_ELBOW, HOME_GRIPPER);
+  Serial.println("Moving to home position");
 }
 
 // Predefined movements
 void RobotArm::performScan() {
   moveToHome();
   for (int angle = 0; angle <= 180; angle += 45) {
-    moveToAngle(baseServo, &baseAngle, angle);
-    delay(500);
+    moveJoints(angle, KEEP, KEEP, KEEP);
+    wait(500);
   }
-  moveToAngle(baseServo, &baseAngle, HOME_BASE);
+  moveJoints(HOME_BASE, KEEP, KEEP, KEEP);
 }
 
 void RobotArm::performPick() {
-  moveToAngle(gripperServo, &gripperAngle, GRIPPER_OPEN);
-  moveToAngle(shoulderServo, &shoulderAngle, 45);
-  moveToAngle(elbowServo, &elbowAngle, 45);
-  moveToAngle(gripperServo, &gripperAngle, GRIPPER_CLOSE);
-  moveToAngle(shoulderServo, &shoulderAngle, 90);
-  moveToAngle(elbowServo, &elbowAngle, 90);
+  // Open on the way down, close at the bottom, lift
+  moveJoints(KEEP, 45, 45, GRIPPER_OPEN);
+  moveJoints(KEEP, KEEP, KEEP, GRIPPER_CLOSE);
+  moveJoints(KEEP, 90, 90, KEEP);
 }
 
 void RobotArm::performDrop() {
-  moveToAngle(baseServo, &baseAngle, 180);
-  moveToAngle(shoulderServo, &shoulderAngle, 45);
-  moveToAngle(elbowServo, &elbowAngle, 45);
-  moveToAngle(gripperServo, &gripperAngle, GRIPPER_OPEN);
+  moveJoints(180, 45, 45, KEEP);
+  moveJoints(KEEP, KEEP, KEEP, GRIPPER_OPEN);
   moveToHome();
 }
 
 void RobotArm::performWave() {
-  moveToAngle(baseServo, &baseAngle, 90);
-  moveToAngle(shoulderServo, &shoulderAngle, 45);
-  moveToAngle(elbowServo, &elbowAngle, 0);
+  moveJoints(90, 45, 0, KEEP);
 
   for (int i = 0; i < 3; i++) {
-    moveToAngle(elbowServo, &elbowAngle, 45);
-    moveToAngle(elbowServo, &elbowAngle, 0);
+    moveJoints(KEEP, KEEP, 45, KEEP);
+    moveJoints(KEEP, KEEP, 0, KEEP);
   }
 
   moveToHome();
@@ -153,21 +352,18 @@ void RobotArm::performWave() {
 
 void RobotArm::performBow() {
   moveToHome();
-  moveToAngle(shoulderServo, &shoulderAngle, 60);
-  moveToAngle(elbowServo, &elbowAngle, 30);
-  delay(1000);
-  moveToAngle(shoulderServo, &shoulderAngle, 0);
-  moveToAngle(elbowServo, &elbowAngle, 0);
+  moveJoints(KEEP, 60, 30, KEEP);
+  wait(1000);
+  moveJoints(KEEP, 0, 0, KEEP);
   moveToHome();
 }
 
 void RobotArm::performReach() {
   moveToHome();
-  moveToAngle(shoulderServo, &shoulderAngle, 180);
-  moveToAngle(elbowServo, &elbowAngle, 135);
-  delay(1000);
-  moveToAngle(gripperServo, &gripperAngle, GRIPPER_CLOSE);
-  delay(500);
+  moveJoints(KEEP, 180, 135, KEEP);
+  wait(1000);
+  moveJoints(KEEP, KEEP, KEEP, GRIPPER_CLOSE);
+  wait(500);
   moveToHome();
 }
 
@@ -189,11 +385,8 @@ void RobotArm::executeSavedPosition(int posNum) {
     int index = posNum - 1;
     if (positionUsed[index]) {
       Position pos = savedPositions[index];
-      moveToAngle(baseServo, &baseAngle, pos.base);
-      moveToAngle(shoulderServo, &shoulderAngle, pos.shoulder);
-      moveToAngle(elbowServo, &elbowAngle, pos.elbow);
-      moveToAngle(gripperServo, &gripperAngle, pos.gripper);
-      Serial.println("Moved to saved position " + String(posNum));
+      moveJoints(pos.base, pos.shoulder, pos.elbow, pos.gripper);
+      Serial.println("Moving to saved position " + String(posNum));
     } else {
       Serial.println("Position " + String(posNum) + " not yet saved");
     }
@@ -260,6 +453,9 @@ void RobotArm::printCurrentAngles() {
   Serial.print("Elbow: "); Serial.println(elbowAngle);
   Serial.print("Gripper: "); Serial.print(gripperAngle);
   Serial.println(gripperAngle == GRIPPER_OPEN ? " (Open)" : " (Closed)");
+  ArmPoint position = getPosition();
+  Serial.println("Gripper at x " + String(position.x) + " y " + String(position.y) +
+                 " z " + String(position.z) + " mm");
 }
 
 void RobotArm::printSavedPositions() {
@@ -3,18 +3,47 @@
 #define ROBOT_ARM_H
 
 #include <Arduino.h>
-#include <Servo.h>
+#include "TimerServo.h"
+#include "MotionProfile.h"
+#include "ArmKinematics.h"
 #include <EEPROM.h>
 
 class RobotArm {
   public:
     RobotArm(int basePin, int shoulderPin, int elbowPin, int gripperPin);
     void begin();
+    void update();
+
+    // Passed for a joint in moveJoints() to leave it where the moves
+    // queued before leave it
+    static const int KEEP = -1;
 
     // Basic movement controls
     void moveJoint(char joint, char direction);
     void moveToHome();
     void moveGripper(char action);
+    bool moveJoints(int base, int shoulder, int elbow, int gripper, unsigned int durationMs = 0);
+    void setMaxJointSpeed(int degPerSec);
+    void setMaxJointAccel(int degPerSec2);
+    void setJointLimits(int joint, int degPerSec, int degPerSec2);
+    int getJointSpeed(int joint) { return jointSpeed[joint]; }
+    int getJointAccel(int joint) { return jointAccel[joint]; }
+    void setProfile(ProfileType type) { profile = type; }
+    ProfileType getProfile() { return profile; }
+    void stop();
+    bool isMoving() { return queueCount > 0; }
+    int getQueuedCount() { return queueCount; }
+    bool motionCompleted();
+    void setBaseAngle(int angle);
+    int getBaseAngle() { return baseAngle; }
+
+    // Cartesian control, see ArmKinematics for the frame
+    bool moveTo(ArmPoint target, unsigned int durationMs = 0);
+    ArmPoint getPosition();
+    void setLinkLengths(int baseHeight, int upperArm, int forearm);
+    bool jog(char axis, char direction);
+    void setJogStep(int mm);
+    int getJogStep() { return jogStep; }
 
     // Predefined movements
     void performScan();
@@ -42,10 +71,10 @@ class RobotArm {
 
   private:
     // Servo objects
-    Servo baseServo;
-    Servo shoulderServo;
-    Servo elbowServo;
-    Servo gripperServo;
+    TimerServo baseServo;
+    TimerServo shoulderServo;
+    TimerServo elbowServo;
+    TimerServo gripperServo;
 
     // Current angles
     int baseAngle;
@@ -53,6 +82,21 @@ class RobotArm {
     int elbowAngle;
     int gripperAngle;
 
+    // Per joint limits for coordinated moves: base, shoulder, elbow, gripper
+    int jointSpeed[4]; // deg/s
+    int jointAccel[4]; // deg/s^2
+    ProfileType profile;
+
+    ArmKinematics kinematics;
+
+    // Cartesian jogs step from the point the last jog aimed at while the
+    // queue still ends at its pose, so rounding to whole servo degrees
+    // does not build up over a run of jogs
+    int jogStep; // mm
+    ArmPoint jogTarget;
+    int jogPose[3];
+    bool jogValid;
+
     // Pins
     int basePin;
     int shoulderPin;
@@ -70,6 +114,11 @@ class RobotArm {
     static const int HOME_ELBOW = 90;
     static const int HOME_GRIPPER = 90;
     static const int MAX_COMMANDS = 20;
+    static const int FRAME_TIME = 20; // ms, one servo pulse frame
+    static const int MAX_SEGMENTS = 16;
+    static const int BASE_HEIGHT = 60; // mm, base plate to shoulder axis
+    static const int UPPER_ARM = 80;   // mm, shoulder to elbow axis
+    static const int FOREARM = 80;     // mm, elbow axis to gripper tip
 
     // Saved positions
     struct Position {
@@ -81,14 +130,33 @@ class RobotArm {
     Position savedPositions[3];
     bool positionUsed[3];
 
+    // Queued moves, run by update() one servo frame at a time. A move
+    // to the pose the arm already has is a pause for its duration
+    struct Segment {
+      uint8_t target[4];     // Base, shoulder, elbow, gripper
+      unsigned int duration; // ms, stretched to respect the joint limits
+    };
+    Segment queue[MAX_SEGMENTS];
+    uint8_t queueHead;
+    uint8_t queueCount;
+    int segmentStart[4];
+    long segmentSteps; // Frames, 0 while no segment is running
+    long segmentStep;
+    ProfileType segmentProfile;
+    uint8_t lastFrame;
+    bool motionDone;
+
     // Command recording
     String recordedCommands[MAX_COMMANDS];
     int commandCount;
     bool recording;
 
     // Helper functions
-    void moveServo(Servo &servo, char direction, int *currentAngle);
-    void moveToAngle(Servo &servo, int *currentAngle, int targetAngle);
+    void wait(unsigned int ms);
+    void startSegment();
+    void queuedPose(int pose[4]);
+    int jointAngle(int joint);
+    void writeJoint(int joint, int angle);
     void loadPositionsFromEEPROM();
     void savePositionsToEEPROM();
 };
@@ -0,0 +1,145 @@
+#include "StopCalibration.h"
+
+StopCalibration::StopCalibration(MotorController* m, UltrasonicSensor* s) {
+    motors = m;
+    sensor = s;
+    state = CAL_IDLE;
+    stopMode = STOP_BRAKE;
+    run = 0;
+    savedSpeed = 0;
+    stopFrom = 0;
+    stateStart = 0;
+    lastReadingTime = 0;
+    for (int i = 0; i < RUN_COUNT; i++) {
+        stoppingDistance[i] = 0;
+    }
+}
+
+void StopCalibration::start(StopMode mode) {
+    stopMode = mode;
+    savedSpeed = motors->getSpeed();
+    run = 0;
+    lastReadingTime = sensor->getReading().timestamp;
+    setState(CAL_BACKING);
+}
+
+void StopCalibration::setState(CalibrationState next) {
+    state = next;
+    stateStart = millis();
+}
+
+// Only readings newer than the last one used count
+bool StopCalibration::freshReading(RangeReading& reading) {
+    reading = sensor->getReading();
+    if (reading.timestamp == lastReadingTime) return false;
+    lastReadingTime = reading.timestamp;
+    return reading.status == RANGE_VALID;
+}
+
+void StopCalibration::update() {
+    if (!isRunning()) return;
+
+    // A missing wall or a stuck robot would otherwise run forever
+    if (millis() - stateStart >= STATE_TIMEOUT) {
+        abort();
+        state = CAL_FAILED;
+        return;
+    }
+
+    RangeReading reading;
+    switch (state) {
+        case CAL_BACKING:
+            if (!freshReading(reading)) return;
+            if (reading.distanceMm >= START_DISTANCE) {
+                motors->stop();
+                setState(CAL_SETTLING);
+            }
+            else {
+                motors->setSpeed(BACKING_SPEED);
+                motors->moveBackward();
+            }
+            break;
+
+        case CAL_SETTLING:
+            if (millis() - stateStart < SETTLE_TIME) return;
+            motors->setSpeed(getRunSpeed(run));
+            motors->moveForward();
+            setState(CAL_APPROACH);
+            break;
+
+        case CAL_APPROACH:
+            if (!freshReading(reading)) return;
+            if (reading.distanceMm <= TRIGGER_DISTANCE) {
+                stopFrom = reading.distanceMm;
+                motors->stop(stopMode);
+                setState(CAL_STOPPING);
+            }
+            break;
+
+        case CAL_STOPPING:
+            // Measure with the first reading completed after coming to rest
+            if (millis() - stateStart < SETTLE_TIME) {
+                lastReadingTime = sensor->getReading().timestamp;
+                return;
+            }
+            if (!freshReading(reading)) return;
+            stoppingDistance[run] = reading.distanceMm < stopFrom ? stopFrom - reading.distanceMm : 0;
+            run++;
+            if (run < RUN_COUNT) {
+                setState(CAL_BACKING);
+            }
+            else {
+                motors->setSpeed(savedSpeed);
+                setState(CAL_DONE);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void StopCalibration::abort() {
+    if (!isRunning()) return;
+    motors->stop(STOP_COAST);
+    motors->setSpeed(savedSpeed);
+    state = CAL_IDLE;
+}
+
+bool StopCalibration::isRunning() {
+    return state != CAL_IDLE && state != CAL_DONE && state != CAL_FAILED;
+}
+
+CalibrationState StopCalibration::getState() {
+    return state;
+}
+
+int StopCalibration::getRunCount() {
+    return RUN_COUNT;
+}
+
+// Runs are spread evenly from 100 up to full speed
+int StopCalibration::getRunSpeed(int index) {
+    return 100 + index * (255 - 100) / (RUN_COUNT - 1);
+}
+
+uint16_t StopCalibration::getStoppingDistance(int index) {
+    return stoppingDistance[constrain(index, 0, RUN_COUNT - 1)];
+}
+
+// Linear between the measured speeds, scaled down below the slowest
+uint16_t StopCalibration::getStoppingDistanceAt(int speed) {
+    if (speed <= getRunSpeed(0)) {
+        return (long)stoppingDistance[0] * max(speed, 0) / getRunSpeed(0);
+    }
+    for (int i = 1; i < RUN_COUNT; i++) {
+        int upper = getRunSpeed(i);
+        if (speed <= upper || i == RUN_COUNT - 1) {
+            int lower = getRunSpeed(i - 1);
+            long span = (long)stoppingDistance[i] - stoppingDistance[i - 1];
+            long distance = stoppingDistance[i - 1] + span * (min(speed, upper) - lower) / (upper - lower);
+            return max(distance, 0L);
+        }
+    }
+    return stoppingDistance[RUN_COUNT - 1];
+}
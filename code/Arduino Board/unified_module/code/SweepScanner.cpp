@@ -0,0 +1,179 @@
+#include "SweepScanner.h"
+
+SweepScanner::SweepScanner(RobotArm* a, UltrasonicSensor* s, ObstacleAvoidance* oa) {
+    arm = a;
+    sensor = s;
+    avoidance = oa;
+    freeDistance = 500; // Same as the default turn distance
+    state = SCAN_IDLE;
+    stepStart = 0;
+    stepSettle = 0;
+    scanStart = 0;
+    scanDuration = 0;
+    restoreAngle = 90;
+    headingFound = false;
+    bestHeading = 0;
+    currentBin = 0;
+    setResolution(15);
+}
+
+// Rounds down to a step that divides 180, so the last bin lands on 180
+// and the finest step, 5 degrees, fills the histogram exactly. Navigation
+// waiting on the scan for a heading gets as long as the scan can take
+void SweepScanner::setResolution(uint8_t degrees) {
+    if (isScanning()) return;
+    resolution = constrain(degrees, 5, 90);
+    while (180 % resolution != 0) resolution--;
+    binCount = 180 / resolution + 1;
+    if (avoidance != nullptr) {
+        avoidance->setHeadingTimeout(getScanTimeBound() + HEADING_MARGIN);
+    }
+}
+
+uint8_t SweepScanner::getResolution() {
+    return resolution;
+}
+
+void SweepScanner::setFreeDistance(uint16_t distanceMm) {
+    freeDistance = distanceMm;
+}
+
+void SweepScanner::start() {
+    restoreAngle = arm->getBaseAngle();
+    headingFound = false;
+    scanStart = millis();
+    aim(0);
+}
+
+void SweepScanner::aim(uint8_t bin) {
+    int angle = getBinAngle(bin);
+    int travel = abs(angle - arm->getBaseAngle());
+
+    currentBin = bin;
+    arm->setBaseAngle(angle);
+    stepStart = millis();
+    stepSettle = SETTLE_BASE + (unsigned long)travel * SETTLE_PER_DEGREE;
+    state = SCAN_SETTLING;
+}
+
+void SweepScanner::update() {
+    // Answer a pending heading request from navigation
+    if (avoidance != nullptr && avoidance->isAwaitingHeading() && !isScanning()) {
+        start();
+    }
+
+    unsigned long elapsed = millis() - stepStart;
+
+    if (state == SCAN_SETTLING) {
+        if (elapsed >= stepSettle) state = SCAN_RANGING;
+    }
+    else if (state == SCAN_RANGING) {
+        RangeReading reading = sensor->getReading();
+
+        // Only a ping that started after the servo settled describes this bin
+        if (reading.timestamp >= stepStart + stepSettle + ECHO_WINDOW) {
+            if (reading.status == RANGE_VALID) {
+                histogram[currentBin] = reading.distanceMm;
+            }
+            else if (reading.status == RANGE_OUT_OF_RANGE) {
+                histogram[currentBin] = sensor->getMaxRange();
+            }
+            else {
+                histogram[currentBin] = 0;
+            }
+        }
+        else if (elapsed < stepSettle + RANGE_TIMEOUT) {
+            return;
+        }
+        else {
+            histogram[currentBin] = 0; // No reading in time, count as blocked
+        }
+
+        if (currentBin + 1 < binCount) {
+            aim(currentBin + 1);
+        }
+        else {
+            finish();
+        }
+    }
+}
+
+void SweepScanner::finish() {
+    scanDuration = millis() - scanStart;
+    state = SCAN_DONE;
+    arm->setBaseAngle(restoreAngle);
+    findFreeSector();
+
+    if (avoidance != nullptr && avoidance->isAwaitingHeading()) {
+        // A dead end turns the robot around
+        avoidance->steerTo(headingFound ? bestHeading : 180);
+    }
+}
+
+// Picks the centre of the widest run of free bins, preferring the run
+// closest to straight ahead on a tie, much like a vector field histogram
+void SweepScanner::findFreeSector() {
+    int bestWidth = 0;
+    int bestCentre = 0;
+    int runStart = -1;
+
+    for (int i = 0; i <= binCount; i++) {
+        bool free = (i < binCount) && histogram[i] >= freeDistance;
+        if (free && runStart < 0) {
+            runStart = i;
+        }
+        else if (!free && runStart >= 0) {
+            int width = i - runStart;
+            int centre = (getBinAngle(runStart) + getBinAngle(i - 1)) / 2;
+            if (width > bestWidth || (width == bestWidth && abs(centre - 90) < abs(bestCentre - 90))) {
+                bestWidth = width;
+                bestCentre = centre;
+            }
+            runStart = -1;
+        }
+    }
+
+    headingFound = bestWidth > 0;
+    bestHeading = bestCentre - 90;
+}
+
+bool SweepScanner::isScanning() {
+    return state == SCAN_SETTLING || state == SCAN_RANGING;
+}
+
+bool SweepScanner::isDone() {
+    return state == SCAN_DONE;
+}
+
+bool SweepScanner::hasHeading() {
+    return headingFound;
+}
+
+// Heading of the free sector relative to straight ahead, positive to the left
+int SweepScanner::getHeading() {
+    return bestHeading;
+}
+
+uint8_t SweepScanner::getBinCount() {
+    return binCount;
+}
+
+int SweepScanner::getBinAngle(uint8_t bin) {
+    return bin * resolution;
+}
+
+uint16_t SweepScanner::getBin(uint8_t bin) {
+    return bin < binCount ? histogram[bin] : 0;
+}
+
+unsigned long SweepScanner::getScanTime() {
+    return scanDuration;
+}
+
+// Worst case: swinging over from the far end, then every bin settling
+// and timing out on its reading
+unsigned long SweepScanner::getScanTimeBound() {
+    unsigned long firstMove = SETTLE_BASE + 180UL * SETTLE_PER_DEGREE;
+    unsigned long perBin = SETTLE_BASE + (unsigned long)resolution * SETTLE_PER_DEGREE + RANGE_TIMEOUT;
+    return firstMove + RANGE_TIMEOUT + (binCount - 1) * perBin;
+}
@@ -0,0 +1,66 @@
+#ifndef SWEEP_SCANNER_H
+#define SWEEP_SCANNER_H
+
+#include <Arduino.h>
+#include "RobotArm.h"
+#include "UltrasonicSensor.h"
+#include "ObstacleAvoidance.h"
+
+class SweepScanner {
+  private:
+    RobotArm* arm;
+    UltrasonicSensor* sensor;
+    ObstacleAvoidance* avoidance;
+
+    // Polar histogram of clearance, one bin per step across 0-180
+    static const int MAX_BINS = 37;
+    uint16_t histogram[MAX_BINS]; // mm, 0 when unknown
+    uint8_t resolution;           // degrees per bin
+    uint8_t binCount;
+    uint8_t currentBin;
+    uint16_t freeDistance;        // mm a bin needs to count as free
+
+    enum ScanState {
+        SCAN_IDLE,
+        SCAN_SETTLING,
+        SCAN_RANGING,
+        SCAN_DONE
+    };
+    ScanState state;
+    unsigned long stepStart;
+    unsigned long stepSettle;
+    unsigned long scanStart;
+    unsigned long scanDuration;
+    int restoreAngle;
+    bool headingFound;
+    int bestHeading;
+
+    const unsigned int SETTLE_BASE = 60;       // ms for any servo move
+    const unsigned int SETTLE_PER_DEGREE = 3;  // ms per degree travelled
+    const unsigned int ECHO_WINDOW = 30;       // ms, a ping started while settling can't count
+    const unsigned int RANGE_TIMEOUT = 150;    // ms to wait for a reading per bin
+    const unsigned int HEADING_MARGIN = 500;   // ms for navigation to wait beyond the scan
+
+    void aim(uint8_t bin);
+    void finish();
+    void findFreeSector();
+
+  public:
+    SweepScanner(RobotArm* a, UltrasonicSensor* s, ObstacleAvoidance* oa = nullptr);
+    void setResolution(uint8_t degrees);
+    uint8_t getResolution();
+    void setFreeDistance(uint16_t distanceMm);
+    void start();
+    void update();
+    bool isScanning();
+    bool isDone();
+    bool hasHeading();
+    int getHeading();
+    uint8_t getBinCount();
+    int getBinAngle(uint8_t bin);
+    uint16_t getBin(uint8_t bin);
+    unsigned long getScanTime();
+    unsigned long getScanTimeBound();
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef TIMER_ALLOCATION_H
+#define TIMER_ALLOCATION_H
+
+#include <Arduino.h>
+
+// Which hardware timer drives each PWM pin, so a pin map can be checked
+// with static_assert when the sketch builds. Timer 0 runs millis(),
+// timer 2 runs TimerServo, which leaves timer 1 (pins 9 and 10) and
+// timer 0 (pins 5 and 6) for analogWrite()
+#if !defined(__AVR_ATmega328P__)
+#error "TimerAllocation.h maps the ATmega328P (Uno, Nano) timers, add this board's map"
+#endif
+
+const int8_t NO_TIMER = -1;
+const int8_t MILLIS_TIMER = 0;
+const int8_t SERVO_TIMER = 2;
+
+constexpr int8_t pwmTimer(int pin) {
+    return (pin == 5 || pin == 6) ? 0 :
+           (pin == 9 || pin == 10) ? 1 :
+           (pin == 3 || pin == 11) ? 2 : NO_TIMER;
+}
+
+// analogWrite() on the pin keeps working while the servos run
+constexpr bool isFreePwmPin(int pin) {
+    return pwmTimer(pin) != NO_TIMER && pwmTimer(pin) != SERVO_TIMER;
+}
+
+constexpr bool isPinListed(int) {
+    return false;
+}
+
+template <typename... Pins>
+constexpr bool isPinListed(int pin, int first, Pins... rest) {
+    return pin == first || isPinListed(pin, rest...);
+}
+
+// No pin is given two jobs
+constexpr bool arePinsDistinct() {
+    return true;
+}
+
+template <typename... Pins>
+constexpr bool arePinsDistinct(int first, Pins... rest) {
+    return !isPinListed(first, rest...) && arePinsDistinct(rest...);
+}
+
+#endif
@@ -0,0 +1,163 @@
+#include "TimerServo.h"
+
+volatile uint8_t* TimerServo::servoPort[MAX_SERVOS];
+uint8_t TimerServo::servoMask[MAX_SERVOS];
+volatile uint16_t TimerServo::pulseTicks[MAX_SERVOS];
+uint8_t TimerServo::servoCount = 0;
+int8_t TimerServo::activeChannel = -1;
+uint16_t TimerServo::remainingTicks = 0;
+uint16_t TimerServo::frameTicks = 0;
+volatile uint8_t TimerServo::frameCount = 0;
+
+// Timer 2 counts at F_CPU / 32, 2us per tick at 16MHz
+uint16_t TimerServo::toTicks(unsigned int us) {
+    return (unsigned long)us * (F_CPU / 1000000UL) / 32;
+}
+
+unsigned int TimerServo::toMicroseconds(uint16_t ticks) {
+    return (unsigned long)ticks * 32 / (F_CPU / 1000000UL);
+}
+
+TimerServo::TimerServo() {
+    channel = NO_CHANNEL;
+}
+
+// Returns the channel, or 255 when all are taken. Channels are never
+// given back, a detached servo only stops pulsing
+uint8_t TimerServo::attach(uint8_t pin) {
+    bool added = channel == NO_CHANNEL;
+    if (added) {
+        if (servoCount >= MAX_SERVOS) return NO_CHANNEL;
+        channel = servoCount;
+    }
+
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
+    uint8_t oldSREG = SREG;
+    cli();
+    servoPort[channel] = portOutputRegister(digitalPinToPort(pin));
+    servoMask[channel] = digitalPinToBitMask(pin);
+    pulseTicks[channel] = toTicks(1500);
+    if (added) servoCount++;
+    SREG = oldSREG;
+
+    if (added && channel == 0) startTimer();
+    return channel;
+}
+
+void TimerServo::detach() {
+    if (channel == NO_CHANNEL) return;
+    uint8_t oldSREG = SREG;
+    cli();
+    // Finish a pulse in flight rather than leave the pin high
+    if (activeChannel == channel) *servoPort[channel] &= ~servoMask[channel];
+    servoPort[channel] = nullptr;
+    SREG = oldSREG;
+}
+
+bool TimerServo::attached() {
+    return channel != NO_CHANNEL && servoPort[channel] != nullptr;
+}
+
+void TimerServo::write(int angle) {
+    // Like the Servo library, values from MIN_PULSE up are pulse widths
+    if (angle >= MIN_PULSE) {
+        writeMicroseconds(angle);
+        return;
+    }
+    angle = constrain(angle, 0, 180);
+    writeMicroseconds(map(angle, 0, 180, MIN_PULSE, MAX_PULSE));
+}
+
+void TimerServo::writeMicroseconds(int us) {
+    if (channel == NO_CHANNEL) return;
+    uint16_t ticks = toTicks(constrain(us, MIN_PULSE, MAX_PULSE));
+    uint8_t oldSREG = SREG;
+    cli();
+    pulseTicks[channel] = ticks;
+    SREG = oldSREG;
+}
+
+int TimerServo::read() {
+    // Rounded, so write(angle) reads back the same angle
+    long us = readMicroseconds();
+    return ((us - MIN_PULSE) * 180 + (MAX_PULSE - MIN_PULSE) / 2) / (MAX_PULSE - MIN_PULSE);
+}
+
+int TimerServo::readMicroseconds() {
+    if (channel == NO_CHANNEL) return 0;
+    uint8_t oldSREG = SREG;
+    cli();
+    uint16_t ticks = pulseTicks[channel];
+    SREG = oldSREG;
+    return toMicroseconds(ticks);
+}
+
+// Counts up once every pulse train is out, so pulse widths written
+// from then on go out together in the next frame
+uint8_t TimerServo::getFrameCount() {
+    return frameCount;
+}
+
+// CTC mode, so each compare match restarts the count from zero and
+// the chunks add up without drift
+void TimerServo::startTimer() {
+    uint8_t oldSREG = SREG;
+    cli();
+    TCCR2A = (1 << WGM21);
+    TCCR2B = (1 << CS21) | (1 << CS20);
+    TCNT2 = 0;
+    activeChannel = -1;
+    frameTicks = 0;
+    remainingTicks = toTicks(FRAME_TIME);
+    scheduleNext();
+    TIFR2 = (1 << OCF2A);
+    TIMSK2 |= (1 << OCIE2A);
+    SREG = oldSREG;
+}
+
+// The 8-bit timer covers at most 256 ticks, so longer intervals are
+// run as several chunks, none shorter than MIN_CHUNK
+void TimerServo::scheduleNext() {
+    uint16_t chunk = remainingTicks;
+    if (chunk > 256) chunk = chunk >= 256 + MIN_CHUNK ? 256 : chunk / 2;
+    else if (chunk < MIN_CHUNK) chunk = MIN_CHUNK;
+    remainingTicks = remainingTicks > chunk ? remainingTicks - chunk : 0;
+    OCR2A = chunk - 1;
+}
+
+void TimerServo::handleInterrupt() {
+    if (remainingTicks > 0) {
+        scheduleNext();
+        return;
+    }
+
+    // The current interval is over: end its pulse and start the next
+    if (activeChannel >= 0 && servoPort[activeChannel] != nullptr) {
+        *servoPort[activeChannel] &= ~servoMask[activeChannel];
+    }
+    activeChannel++;
+    if (activeChannel < servoCount) {
+        if (servoPort[activeChannel] != nullptr) {
+            *servoPort[activeChannel] |= servoMask[activeChannel];
+            remainingTicks = pulseTicks[activeChannel];
+        }
+        else {
+            remainingTicks = MIN_CHUNK;
+        }
+        frameTicks += remainingTicks;
+    }
+    else {
+        // Rest until the frame is up
+        uint16_t frame = toTicks(FRAME_TIME);
+        remainingTicks = frameTicks + MIN_CHUNK < frame ? frame - frameTicks : MIN_CHUNK;
+        activeChannel = -1;
+        frameTicks = 0;
+        frameCount++;
+    }
+    scheduleNext();
+}
+
+ISR(TIMER2_COMPA_vect) {
+    TimerServo::handleInterrupt();
+}
@@ -0,0 +1,51 @@
+#ifndef TIMER_SERVO_H
+#define TIMER_SERVO_H
+
+#include <Arduino.h>
+#include "TimerAllocation.h"
+
+// Servo pulses from one Timer 2 interrupt, a drop-in for the Servo
+// library's attach()/write()/read(). The Servo library takes Timer 1,
+// which stops analogWrite() on pins 9 and 10, the motor enables.
+// Servos are pulsed one after another, then the line rests for the
+// remainder of the 20ms frame
+class TimerServo {
+  private:
+    static const uint8_t MAX_SERVOS = 6;
+    static const uint8_t NO_CHANNEL = 255;
+    static const int MIN_PULSE = 544;  // us at 0 degrees, as the Servo library
+    static const int MAX_PULSE = 2400; // us at 180 degrees
+    static const unsigned int FRAME_TIME = 20000; // us
+    static const unsigned int MIN_CHUNK = 32; // Timer ticks, leaves the ISR time to return
+
+    uint8_t channel;
+
+    // Shared with the ISR
+    static volatile uint8_t* servoPort[MAX_SERVOS]; // nullptr when detached
+    static uint8_t servoMask[MAX_SERVOS];
+    static volatile uint16_t pulseTicks[MAX_SERVOS];
+    static uint8_t servoCount;
+    static int8_t activeChannel; // -1 during the rest of the frame
+    static uint16_t remainingTicks;
+    static uint16_t frameTicks; // Spent on pulses this frame
+    static volatile uint8_t frameCount;
+
+    static void startTimer();
+    static void scheduleNext();
+    static uint16_t toTicks(unsigned int us);
+    static unsigned int toMicroseconds(uint16_t ticks);
+
+  public:
+    TimerServo();
+    uint8_t attach(uint8_t pin);
+    void detach();
+    bool attached();
+    void write(int angle);
+    void writeMicroseconds(int us);
+    int read();
+    int readMicroseconds();
+    static uint8_t getFrameCount();
+    static void handleInterrupt(); // Called from the Timer 2 compare ISR
+};
+
+#endif
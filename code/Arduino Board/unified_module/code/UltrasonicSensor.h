@@ -3,18 +3,93 @@
 
 #include <Arduino.h>
 
+enum RangeStatus {
+    RANGE_VALID,
+    RANGE_NO_ECHO,      // Echo never started before the timeout
+    RANGE_TOO_CLOSE,    // Inside the sensor's blind zone
+    RANGE_OUT_OF_RANGE  // Echo longer than the configured maximum range
+};
+
+struct RangeReading {
+    uint16_t distanceMm;     // Only meaningful when status is RANGE_VALID
+    RangeStatus status;
+    unsigned long timestamp; // millis() when the reading completed
+};
+
+enum FilterMode {
+    FILTER_MEDIAN, // Median of the most recent samples, rejects spikes
+    FILTER_EMA     // Exponential moving average, smooths noise
+};
+
 class UltrasonicSensor {
   private:
     uint8_t trigPin, echoPin;
     unsigned long lastReadTime;
-    float lastDistance;
+    uint16_t lastDistanceMm;
+    RangeReading lastReading;
+    uint16_t maxRangeMm;
+    unsigned long echoTimeout;
     const unsigned long READ_INTERVAL = 50; // 50ms between readings
-    
+    const unsigned long ECHO_LATENCY = 1000; // Trigger to echo start, with margin
+    const uint16_t MIN_RANGE_MM = 20; // HC-SR04 blind zone
+
+    // Half the speed of sound in mm/us, Q16 fixed point
+    uint16_t halfSpeedQ16;
+    static const uint32_t SPEED_OF_SOUND_DEFAULT = 340000; // mm/s
+
+    // Valid samples, fed at the sensor's own ping rate
+    static const int FILTER_SIZE = 7;
+    uint16_t sampleBuffer[FILTER_SIZE];
+    uint8_t sampleHead;
+    uint8_t sampleCount;
+    FilterMode filterMode;
+    uint8_t emaAlpha;    // Weight of a new sample, out of 256
+    int32_t emaDistance; // mm, Q4 fixed point
+
+    // Interrupt-driven echo capture
+    bool useInterrupt;
+    volatile uint8_t* echoInput; // Echo pin's input register, read in the ISR
+    uint8_t echoMask;
+    bool autoTrigger;
+    bool pingPending;
+    unsigned long triggerTime;
+    volatile uint8_t echoLevel;
+    volatile bool echoStarted;
+    volatile bool echoReceived;
+    volatile unsigned long echoStart;
+    volatile unsigned long echoDuration;
+
+    static UltrasonicSensor* activeSensor;
+    static void echoISR();
+    void handleEcho();
+    void trigger();
+    void recordEcho(unsigned long duration);
+    void recordFailure(RangeStatus status);
+    void addSample(uint16_t distanceMm);
+    void setSpeedOfSound(uint32_t speed);
+    void updateEchoTimeout();
+
   public:
     UltrasonicSensor(uint8_t trig, uint8_t echo);
     void begin();
+    void update();
+    void startPing();
+    void setAutoTrigger(bool enabled);
+    bool isBusy();
+    void setMaxRange(uint16_t rangeMm);
+    uint16_t getMaxRange();
+    void setTemperature(int8_t celsius);
+    void disableTemperatureCompensation();
+    uint16_t getDistanceMm();
+    uint16_t getFilteredDistanceMm(uint8_t samples = 3);
     float getDistance();
     float getFilteredDistance(int samples = 3);
+    void setFilterMode(FilterMode mode);
+    void setSmoothing(uint8_t alpha);
+    void clearFilter();
+    RangeReading getReading();
+    bool isValid();
+    static const char* statusName(RangeStatus status);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,7 +1,11 @@
-#include "MotorController.h"
+#include "FastMotorController.h"
 #include "UltrasonicSensor.h"
+#include "UltrasonicArray.h"
 #include "ObstacleAvoidance.h"
+#include "Odometry.h"
+#include "StopCalibration.h"
 #include "RobotArm.h"
+#include "SweepScanner.h"
 
 // Pin definitions
 const uint8_t MOTOR1_IN1 = 3;
@@ -12,34 +16,153 @@ const uint8_t MOTOR1_ENA = 9;
 const uint8_t MOTOR2_ENB = 10;
 const uint8_t TRIG_PIN = 12;
 const uint8_t ECHO_PIN = 2;
+const uint8_t LEFT_TRIG_PIN = A0;
+const uint8_t LEFT_ECHO_PIN = A1;
+const uint8_t RIGHT_TRIG_PIN = A2;
+const uint8_t RIGHT_ECHO_PIN = A3;
+const uint8_t LEFT_ENCODER_PIN = A4;
+const uint8_t RIGHT_ENCODER_PIN = A5;
+// Battery and current sensing read A6 and A7, the analog-only pins the
+// Nano and Pro Mini break out. The Uno has no header for them and its
+// A0-A5 carry the side sensors and encoders, so both need a Nano
+const uint8_t BATTERY_PIN = A6;
+const uint16_t BATTERY_FULL_SCALE = 15000; // mV reading as 1023, 3:1 divider
+const uint8_t CURRENT_PIN = A7;
+const uint16_t CURRENT_FULL_SCALE = 10000; // mA reading as 1023, 0.5 ohm shunt
 const int BASE_PIN = 13;
 const int SHOULDER_PIN = 7;
 const int ELBOW_PIN = 8;
 const int GRIPPER_PIN = 11;
 
-MotorController motors(MOTOR1_IN1, MOTOR1_IN2, MOTOR2_IN1, MOTOR2_IN2, MOTOR1_ENA, MOTOR2_ENB);
+// The servos run off Timer 2 and the motor enables need analogWrite(),
+// so check the pin map against the timers before anything is flashed
+static_assert(isFreePwmPin(MOTOR1_ENA) && isFreePwmPin(MOTOR2_ENB),
+              "Motor enable pins need PWM from a timer the servos leave free (pins 5, 6, 9, 10)");
+static_assert(arePinsDistinct(MOTOR1_IN1, MOTOR1_IN2, MOTOR2_IN1, MOTOR2_IN2, MOTOR1_ENA, MOTOR2_ENB,
+                              TRIG_PIN, ECHO_PIN, LEFT_TRIG_PIN, LEFT_ECHO_PIN, RIGHT_TRIG_PIN, RIGHT_ECHO_PIN,
+                              LEFT_ENCODER_PIN, RIGHT_ENCODER_PIN, BATTERY_PIN, CURRENT_PIN,
+                              BASE_PIN, SHOULDER_PIN, ELBOW_PIN, GRIPPER_PIN),
+              "Two functions share a pin");
+
+// The encoders and side echo pins use the A0-A5 pin change interrupt,
+// the only pin change vector the sketch takes over, leaving the others
+// to libraries such as SoftwareSerial
+static_assert(digitalPinToPCICRbit(LEFT_ENCODER_PIN) == 1 && digitalPinToPCICRbit(RIGHT_ENCODER_PIN) == 1 &&
+              digitalPinToPCICRbit(LEFT_ECHO_PIN) == 1 && digitalPinToPCICRbit(RIGHT_ECHO_PIN) == 1,
+              "Encoder and side echo pins need the A0-A5 pin change interrupt claimed below");
+PIN_CHANGE_ISR(1);
+
+// Set to true when left and right ultrasonic sensors are fitted
+bool useSideSensors = false;
+
+// Set to true when wheel encoders are fitted, enables the speed loop
+bool useEncoders = false;
+
+// Set to true when the battery divider is wired to BATTERY_PIN (Nano only)
+bool useBatterySense = false;
+
+// Set to true when the L298N sense pins go through a shunt to CURRENT_PIN
+// (Nano only)
+bool useCurrentSense = false;
+
+#ifdef ARDUINO_AVR_UNO
+const bool HAS_ANALOG_ONLY_PINS = false;
+#else
+const bool HAS_ANALOG_ONLY_PINS = true;
+#endif
+
+FastMotorController<MOTOR1_IN1, MOTOR1_IN2, MOTOR2_IN1, MOTOR2_IN2, MOTOR1_ENA, MOTOR2_ENB> motors;
 UltrasonicSensor sensor(TRIG_PIN, ECHO_PIN);
+UltrasonicSensor leftSensor(LEFT_TRIG_PIN, LEFT_ECHO_PIN);
+UltrasonicSensor rightSensor(RIGHT_TRIG_PIN, RIGHT_ECHO_PIN);
+UltrasonicArray sonar;
 ObstacleAvoidance oa(&motors, &sensor);
+Odometry odometry(&motors);
+StopCalibration calibration(&motors, &sensor);
 RobotArm arm(BASE_PIN, SHOULDER_PIN, ELBOW_PIN, GRIPPER_PIN);
+SweepScanner scanner(&arm, &sensor, &oa);
 
 String command = "";
+String boundedMove = ""; // Last bounded move, for its acknowledgement
+bool scanReportPending = false;
+bool calibrationReportPending = false;
+uint8_t reportedStalls = 0;
+String inputBuffer = "";
+
+// Command latency, from the first byte of a command to the end of its
+// execution, and the longest loop() pass that could delay it
+unsigned long commandStartTime = 0;
+unsigned long lastCommandLatency = 0;
+unsigned long maxCommandLatency = 0;
+unsigned long lastLoopTime = 0;
+unsigned long maxLoopTime = 0;
 
 void setup() {
     Serial.begin(115200);
     motors.begin();
+    if (useEncoders) {
+        motors.attachEncoders(LEFT_ENCODER_PIN, RIGHT_ENCODER_PIN);
+    }
+    if ((useBatterySense || useCurrentSense) && !HAS_ANALOG_ONLY_PINS) {
+        Serial.println("Battery and current sense need A6/A7, which the Uno lacks");
+    }
+    else {
+        if (useBatterySense) {
+            motors.attachBattery(BATTERY_PIN, BATTERY_FULL_SCALE);
+        }
+        if (useCurrentSense) {
+            motors.attachCurrentSense(CURRENT_PIN, CURRENT_FULL_SCALE);
+        }
+    }
     sensor.begin();
+    if (useSideSensors) {
+        beginSideSensors();
+    }
     oa.begin();
+    odometry.begin();
     arm.begin();
+    inputBuffer.reserve(32);
     Serial.println(" ");
 }
 
 void loop() {
-    if (oa.isActive()) {
-        oa.check();
+    // Slew the motor outputs toward their targets, then track the pose
+    motors.update();
+    odometry.update();
+    if (motors.getStallCount() != reportedStalls) {
+        reportedStalls = motors.getStallCount();
+        boundedMove = "stall back-off";
+        printMessage("Stall, backing off at " + String(motors.getCurrent()) + " mA");
+    }
+    if (motors.motionCompleted()) {
+        printMessage("Done: " + boundedMove);
     }
 
-    if (Serial.available() > 0) {
-        command = Serial.readStringUntil('\n');
+    if (useSideSensors) {
+        sonar.update();
+    } else {
+        sensor.update();
+    }
+
+    // Avoidance, navigation, scanning and arm moves run as background behaviors
+    oa.update();
+    scanner.update();
+    arm.update();
+    if (arm.motionCompleted()) {
+        printMessage("Arm motion done");
+        arm.printCurrentAngles();
+    }
+    if (scanReportPending && scanner.isDone()) {
+        printScan();
+        scanReportPending = false;
+    }
+    calibration.update();
+    if (calibrationReportPending && !calibration.isRunning()) {
+        finishCalibration();
+        calibrationReportPending = false;
+    }
+
+    if (readCommand()) {
         command.trim();
         command.toLowerCase();
 
@@ -48,13 +171,103 @@ void loop() {
         } else {
             executeCommand(command);
         }
+
+        lastCommandLatency = micros() - commandStartTime;
+        maxCommandLatency = max(maxCommandLatency, lastCommandLatency);
     }
+
+    unsigned long now = micros();
+    if (lastLoopTime != 0) {
+        maxLoopTime = max(maxLoopTime, now - lastLoopTime);
+    }
+    lastLoopTime = now;
+}
+
+// Collects serial input without blocking; returns true once a full
+// line is available in command
+bool readCommand() {
+    while (Serial.available() > 0) {
+        char c = Serial.read();
+        if (inputBuffer.length() == 0) {
+            commandStartTime = micros();
+        }
+        if (c == '\n') {
+            command = inputBuffer;
+            inputBuffer = "";
+            return true;
+        }
+        inputBuffer += c;
+    }
+    return false;
+}
+
+void beginSideSensors() {
+    // Side sensors only need short range; their echoes come in on the
+    // pin change interrupt claimed above, so pinging never blocks loop()
+    leftSensor.begin();
+    rightSensor.begin();
+    leftSensor.setMaxRange(1500);
+    rightSensor.setMaxRange(1500);
+
+    sonar.attach(SENSOR_FRONT, &sensor);
+    sonar.attach(SENSOR_LEFT, &leftSensor);
+    sonar.attach(SENSOR_RIGHT, &rightSensor);
+    sonar.begin();
+    oa.setSensorArray(&sonar);
+}
+
+// One sensor's part of the sonar report: its distance, why it has none,
+// or off when it isn't fitted, so a missing sensor can't read as 0 mm
+String sonarReading(UltrasonicSensor& ranger, bool fitted) {
+    if (!fitted) return "off";
+    RangeStatus status = ranger.getReading().status;
+    if (status != RANGE_VALID) return UltrasonicSensor::statusName(status);
+    return String(ranger.getFilteredDistanceMm(3)) + " mm";
 }
 
 void printMessage(const String &message) {
     Serial.println(message);
 }
 
+// Starts a movement command by name
+void startMotion(String name) {
+    if (name == "mv") motors.moveForward();
+    else if (name == "bk") motors.moveBackward();
+    else if (name == "lt") motors.turnLeft();
+    else if (name == "rt") motors.turnRight();
+    else if (name == "rl") motors.rotateLeft();
+    else if (name == "rr") motors.rotateRight();
+}
+
+bool isMovement(String name) {
+    return name == "mv" || name == "bk" || name == "lt" || name == "rt" || name == "rl" || name == "rr";
+}
+
+// Parses "<move> <amount><unit>", e.g. "mv 30cm", "rl 90deg" or "bk 500ms".
+// The motors stop by themselves and the move is acknowledged from loop()
+void startBoundedMove(String command) {
+    String name = command.substring(0, 2);
+    String arg = command.substring(3);
+    unsigned long amount = arg.toInt();
+    MotionBound type;
+    if (arg.endsWith("ms")) {
+        type = BOUND_TIME;
+    } else if (arg.endsWith("cm")) {
+        type = BOUND_DISTANCE;
+        amount *= 10;
+    } else if (arg.endsWith("mm")) {
+        type = BOUND_DISTANCE;
+    } else if (arg.endsWith("deg") && name != "mv" && name != "bk") {
+        type = BOUND_ANGLE;
+    } else {
+        printMessage("Usage: " + name + " <n>ms, <n>cm or <n>mm, turns also <n>deg");
+        return;
+    }
+    startMotion(name);
+    motors.limitMotion(type, amount);
+    boundedMove = command;
+}
+
 void processRecordingMode(String command) {
     if (command == "done") {
         arm.stopRecording();
@@ -74,25 +287,234 @@ void executeCommand(String command) {
     else if (command == "rt") { motors.turnRight(); }
     else if (command == "rl") { motors.rotateLeft(); }
     else if (command == "rr") { motors.rotateRight(); }
-    else if (command == "st") { motors.stop(); }
+    else if (command.length() > 3 && command.charAt(2) == ' ' && isMovement(command.substring(0, 2))) {
+        startBoundedMove(command);
+    }
+    else if (command == "st" || command == "st brake" || command == "st coast") {
+        if (oa.isNavigating()) {
+            oa.stopNavigation();
+            printMessage("Navigation stopped");
+        }
+        oa.abortManeuver();
+        calibration.abort();
+        if (command == "st brake") {
+            motors.stop(STOP_BRAKE);
+        } else if (command == "st coast") {
+            motors.stop(STOP_COAST);
+        } else {
+            motors.stop();
+        }
+    }
+    else if (command.startsWith("brake ")) {
+        int brakeTime = command.substring(6).toInt();
+        motors.setBrakeTime(brakeTime);
+        printMessage("Brake time set to: " + String(brakeTime) + " ms");
+    }
+    else if (command == "cal brake" || command == "cal coast") {
+        startCalibration(command == "cal brake" ? STOP_BRAKE : STOP_COAST);
+    }
     
     else if (command.startsWith("spd ")) {
         int speed = command.substring(4).toInt();
         motors.setSpeed(speed);
         printMessage("Speed set to: " + String(speed));
     }
+    else if (command.startsWith("ramp ")) {
+        setMotorRamp(command.substring(5));
+    }
+    else if (command == "pose") {
+        printMessage("Pose: x " + String(odometry.getX()) + " mm, y " + String(odometry.getY()) + " mm, heading " +
+                     String(odometry.getHeading() / 100.0) + " deg");
+    }
+    else if (command == "pose reset") {
+        odometry.reset();
+        printMessage("Pose reset");
+    }
+    else if (command.startsWith("pose track ")) {
+        int track = command.substring(11).toInt();
+        motors.setTrackWidth(track);
+        printMessage("Track width set to: " + String(track) + " mm");
+    }
+    else if (command.startsWith("pose model ")) {
+        setPwmModel(command.substring(11));
+    }
+    else if (command == "enc on") {
+        if (motors.setClosedLoop(true)) {
+            printMessage("Speed loop on, speeds in ticks/s");
+        } else {
+            printMessage("No encoders attached");
+        }
+    }
+    else if (command == "enc off") {
+        motors.setClosedLoop(false);
+        printMessage("Speed loop off, speeds in PWM");
+    }
+    else if (command == "enc") {
+        printWheelTelemetry();
+    }
+    else if (command.startsWith("enc gains ")) {
+        setSpeedGains(command.substring(10));
+    }
+    else if (command == "trim") {
+        printTrim();
+    }
+    else if (command == "trim save") {
+        motors.saveCalibration();
+        printMessage("Motor trim saved");
+    }
+    else if (command == "trim reset") {
+        motors.resetCalibration();
+        printMessage("Motor trim reset, trim save to keep it");
+    }
+    else if (command.startsWith("trim l ") || command.startsWith("trim r ")) {
+        setTrim(command.charAt(5) == 'l' ? WHEEL_LEFT : WHEEL_RIGHT, command.substring(7));
+    }
+    else if (command.startsWith("batt ")) {
+        int voltage = command.substring(5).toInt();
+        motors.setNominalVoltage(voltage);
+        printMessage("Nominal battery voltage set to: " + String(voltage) + " mV");
+    }
+    else if (command == "cur") {
+        printMessage("Motor current: " + String(motors.getCurrent()) + " mA, stalls " + String(motors.getStallCount()));
+    }
+    else if (command.startsWith("cur limit ")) {
+        setStallLimits(command.substring(10));
+    }
+    else if (command.startsWith("drv ")) {
+        driveWheels(command.substring(4));
+    }
+    else if (command.startsWith("arc ")) {
+        driveArc(command.substring(4));
+    }
 
     else if (command == "oa on") { oa.enable(); }
     else if (command == "oa off") { oa.disable(); }
     else if (command == "oa nav") {
-        startNavigationMode();
+        oa.startNavigation();
+        printMessage("Starting autonomous navigation");
+    }
+    else if (command == "oa ttc") {
+        oa.setMode(AVOID_TTC);
+        printMessage("Avoidance mode: time-to-collision");
+    }
+    else if (command == "oa fixed") {
+        oa.setMode(AVOID_FIXED);
+        printMessage("Avoidance mode: fixed distances");
+    }
+    else if (command == "oa scan on") {
+        oa.setScanOnStop(true);
+        printMessage("Scan on stop enabled");
+    }
+    else if (command == "oa scan off") {
+        oa.setScanOnStop(false);
+        printMessage("Scan on stop disabled");
+    }
+    else if (command.startsWith("oa dist ")) {
+        setAvoidanceDistances(command.substring(8));
+    }
+    else if (command == "oa stat") {
+        printEscapeStats();
+    }
+    else if (command == "oa stat clear") {
+        oa.clearStats();
+        printMessage("Escape statistics cleared");
+    }
+
+    else if (command == "lat") {
+        printMessage("Command latency: " + String(lastCommandLatency) + " us (max " + String(maxCommandLatency) +
+                     " us), max loop time: " + String(maxLoopTime) + " us");
+        maxCommandLatency = 0;
+        maxLoopTime = 0;
     }
 
     else if (command == "dist") {
         float distance = sensor.getFilteredDistance(5);
-        printMessage("Distance: " + String(distance) + " cm");
+        if (sensor.isValid()) {
+            printMessage("Distance: " + String(distance) + " cm");
+        } else {
+            printMessage("Distance: " + String(UltrasonicSensor::statusName(sensor.getReading().status)));
+        }
+    }
+
+    else if (command == "sonar") {
+        String rate = useSideSensors ? ", Rate: " + String(sonar.getUpdateRate()) + " Hz" : "";
+        printMessage("Front: " + sonarReading(sensor, true) + ", Left: " + sonarReading(leftSensor, useSideSensors) +
+                     ", Right: " + sonarReading(rightSensor, useSideSensors) + rate);
+    }
+
+    else if (command == "scan" || command.startsWith("scan ")) {
+        if (command.length() > 5) {
+            scanner.setResolution(command.substring(5).toInt());
+        }
+        scanner.start();
+        scanReportPending = true;
+        printMessage("Scanning every " + String(scanner.getResolution()) + " deg, max " +
+                     String(scanner.getScanTimeBound()) + " ms");
+    }
+
+    else if (command.startsWith("temp ")) {
+        int celsius = command.substring(5).toInt();
+        sensor.setTemperature(celsius);
+        leftSensor.setTemperature(celsius);
+        rightSensor.setTemperature(celsius);
+        printMessage("Temperature set to: " + String(celsius) + " C");
     }
 
+    else if (command == "arm") {
+        printMessage(arm.isMoving() ? "Arm moving, " + String(arm.getQueuedCount()) + " moves queued" : "Arm idle");
+        arm.printCurrentAngles();
+    }
+    else if (command == "arm stop") {
+        arm.stop();
+        printMessage("Arm stopped");
+    }
+    else if (command.startsWith("arm speed ")) {
+        int speed = command.substring(10).toInt();
+        arm.setMaxJointSpeed(speed);
+        printMessage("Arm joint speed set to: " + String(arm.getJointSpeed(0)) + " deg/s");
+    }
+    else if (command.startsWith("arm accel ")) {
+        int accel = command.substring(10).toInt();
+        arm.setMaxJointAccel(accel);
+        printMessage("Arm joint acceleration set to: " + String(arm.getJointAccel(0)) + " deg/s^2");
+    }
+    else if (command.startsWith("arm joint ")) {
+        // arm joint <b|s|e|g> <deg/s> <deg/s^2>
+        int joint = String("bseg").indexOf(command.charAt(10));
+        int firstSpace = command.indexOf(' ', 11);
+        int secondSpace = command.indexOf(' ', firstSpace + 1);
+        if (joint < 0 || firstSpace == -1 || secondSpace == -1) {
+            printMessage("Usage: arm joint <b|s|e|g> <deg/s> <deg/s^2>");
+        }
+        else {
+            arm.setJointLimits(joint, command.substring(firstSpace + 1, secondSpace).toInt(),
+                               command.substring(secondSpace + 1).toInt());
+            printMessage("Arm joint limits: " + String(arm.getJointSpeed(joint)) + " deg/s, " +
+                         String(arm.getJointAccel(joint)) + " deg/s^2");
+        }
+    }
+    else if (isCartesianJog(command)) {
+        arm.jog(command.charAt(0), command.charAt(command.length() - 1));
+    }
+    else if (command.startsWith("jog ")) {
+        arm.setJogStep(command.substring(4).toInt());
+        printMessage("Arm jog step set to: " + String(arm.getJogStep()) + " mm");
+    }
+    else if (command.startsWith("goto ")) {
+        moveArmTo(command.substring(5));
+    }
+    else if (command.startsWith("arm links ")) {
+        setArmLinks(command.substring(10));
+    }
+    else if (command.startsWith("arm profile")) {
+        String type = command.substring(11);
+        type.trim();
+        if (type == "linear") arm.setProfile(PROFILE_LINEAR);
+        else if (type == "trap") arm.setProfile(PROFILE_TRAPEZOID);
+        else if (type == "scurve") arm.setProfile(PROFILE_SCURVE);
+        else if (type.length() > 0) printMessage("Usage: arm profile <linear|trap|scurve>");
+        printMessage("Arm profile: " + String(profileName(arm.getProfile())));
+    }
     else if (command.length() >= 3) {
         handleArmCommands(command);
     } 
@@ -123,25 +545,236 @@ void handleArmCommands(String command) {
     if (command == "stream") {
         arm.startRecording();
     }
+}
 
-    if (type == 'b' || type == 's' || type == 'e' || type == 'g') {
-        arm.printCurrentAngles();
+// Drives at a wall ahead at several speeds, avoidance must stay out of it
+void startCalibration(StopMode mode) {
+    if (oa.isNavigating()) {
+        oa.stopNavigation();
     }
+    oa.disable();
+    calibration.start(mode);
+    calibrationReportPending = true;
+    printMessage("Calibrating stopping distance, avoidance disabled");
 }
 
-void startNavigationMode() {
-    oa.enable();
-    printMessage("Starting autonomous navigation");
-    while (oa.isActive()) {
-        oa.navigate();
-        if (Serial.available() > 0) {
-            String stopCmd = Serial.readStringUntil('\n');
-            stopCmd.trim();
-            if (stopCmd == "st") break;
-        }
+void finishCalibration() {
+    if (calibration.getState() != CAL_DONE) {
+        printMessage("Calibration stopped, no wall in range or robot stuck");
+        return;
+    }
+    Serial.println("\nStopping distance:");
+    for (int i = 0; i < calibration.getRunCount(); i++) {
+        Serial.print("  speed "); Serial.print(calibration.getRunSpeed(i));
+        Serial.print(": "); Serial.print(calibration.getStoppingDistance(i)); Serial.println(" mm");
+    }
+    uint16_t stopping = calibration.getStoppingDistanceAt(motors.getSpeed());
+    oa.setStoppingDistance(stopping);
+    printMessage("Avoidance distances derived for speed " + String(motors.getSpeed()) + " (" + String(stopping) +
+                 " mm to stop), oa on to re-enable");
+}
+
+void printScan() {
+    Serial.println("\nScan (" + String(scanner.getScanTime()) + " ms):");
+    for (uint8_t i = 0; i < scanner.getBinCount(); i++) {
+        Serial.print("  "); Serial.print(scanner.getBinAngle(i));
+        Serial.print(": "); Serial.print(scanner.getBin(i)); Serial.println(" mm");
+    }
+    if (scanner.hasHeading()) {
+        printMessage("Free heading: " + String(scanner.getHeading()) + " deg");
+    } else {
+        printMessage("No free sector");
+    }
+}
+
+void printEscapeStats() {
+    printMessage("Escapes: level " + String(oa.getEscalation()) + ", " + String(oa.getEpisodeCount()) +
+                 " cleared, time to clear " + String(oa.getLastTimeToClear()) + " ms (max " +
+                 String(oa.getMaxTimeToClear()) + " ms)");
+    unsigned long now = millis();
+    for (int i = 0; i < oa.getHistoryCount(); i++) {
+        EscapeRecord record = oa.getHistory(i);
+        Serial.print("  -"); Serial.print(now - record.time); Serial.print(" ms: ");
+        Serial.print(record.rotatedLeft ? "left" : "right");
+        Serial.print(", level "); Serial.print(record.level);
+        Serial.println(record.cleared ? ", cleared" : "");
+    }
+}
+
+void printWheelTelemetry() {
+    const char* names[2] = {"Left", "Right"};
+    for (int i = 0; i < 2; i++) {
+        WheelTelemetry wheel = motors.getTelemetry((Wheel)i);
+        printMessage(String(names[i]) + ": target " + String(wheel.setpoint) + ", measured " + String(wheel.measured) +
+                     " ticks/s, error " + String(wheel.setpoint - wheel.measured) + " (peak " +
+                     String(wheel.peakError) + "), pwm " + String(wheel.pwm));
+    }
+    motors.clearPeakErrors();
+}
+
+// Parses "<mm/s at full PWM> <dead band>"
+void setPwmModel(String args) {
+    int space = args.indexOf(' ');
+    if (space < 0) {
+        printMessage("Usage: pose model <mm/s> <deadband>");
+        return;
+    }
+    int speed = args.substring(0, space).toInt();
+    int deadband = args.substring(space + 1).toInt();
+    motors.setPwmModel(speed, deadband);
+    printMessage("Wheel model set to: " + String(speed) + " mm/s, dead band " + String(deadband));
+}
+
+// Parses "<offset> <gain %> <dead band>" for one motor
+void setTrim(Wheel wheel, String args) {
+    int first = args.indexOf(' ');
+    int second = args.indexOf(' ', first + 1);
+    if (first < 0 || second < 0) {
+        printMessage("Usage: trim <l|r> <offset> <gain %> <deadband>");
+        return;
+    }
+    int offset = args.substring(0, first).toInt();
+    int gain = args.substring(first + 1, second).toInt();
+    int deadband = args.substring(second + 1).toInt();
+    motors.setTrim(wheel, constrain(offset, -100, 100), constrain(gain, 0, 200) * 256L / 100, constrain(deadband, 0, 254));
+    printMessage("Trim set to: offset " + String(offset) + ", gain " + String(gain) + "%, dead band " + String(deadband));
+}
+
+void printTrim() {
+    const char* names[2] = {"Left", "Right"};
+    for (int i = 0; i < 2; i++) {
+        MotorTrim trim = motors.getTrim((Wheel)i);
+        printMessage(String(names[i]) + ": offset " + String(trim.offset) + ", gain " +
+                     String((trim.gain * 100L + 128) / 256) + "%, dead band " + String(trim.deadband));
+    }
+    printMessage("Battery: " + String(motors.getBatteryVoltage()) + " mV, nominal " +
+                 String(motors.getNominalVoltage()) + " mV");
+}
+
+// Parses "<stall mA> <stall ms> <peak mA>"
+void setStallLimits(String args) {
+    int first = args.indexOf(' ');
+    int second = args.indexOf(' ', first + 1);
+    if (first < 0 || second < 0) {
+        printMessage("Usage: cur limit <stall mA> <ms> <peak mA>");
+        return;
+    }
+    int stallCurrent = args.substring(0, first).toInt();
+    int stallTime = args.substring(first + 1, second).toInt();
+    int peakCurrent = args.substring(second + 1).toInt();
+    motors.setStallLimits(stallCurrent, stallTime, peakCurrent);
+    printMessage("Stall limits set to: " + String(stallCurrent) + " mA for " + String(stallTime) +
+                 " ms, peak " + String(peakCurrent) + " mA");
+}
+
+// Parses "<feedforward> <kp> <ki>", each in 1/256 PWM units
+void setSpeedGains(String args) {
+    int first = args.indexOf(' ');
+    int second = args.indexOf(' ', first + 1);
+    if (first < 0 || second < 0) {
+        printMessage("Usage: enc gains <feedforward> <kp> <ki>");
+        return;
+    }
+    int feedForward = args.substring(0, first).toInt();
+    int kp = args.substring(first + 1, second).toInt();
+    int ki = args.substring(second + 1).toInt();
+    motors.setSpeedGains(feedForward, kp, ki);
+    printMessage("Speed gains set to: " + String(feedForward) + "/" + String(kp) + "/" + String(ki));
+}
+
+// Parses "<left> <right>" signed PWM
+void driveWheels(String args) {
+    int space = args.indexOf(' ');
+    if (space < 0) {
+        printMessage("Usage: drv <left> <right>");
+        return;
+    }
+    int left = args.substring(0, space).toInt();
+    int right = args.substring(space + 1).toInt();
+    motors.setWheelSpeeds(left, right);
+    printMessage("Wheels: " + String(left) + "/" + String(right));
+}
+
+// "x+", "y -" and so on: one Cartesian jog step of the gripper tip
+bool isCartesianJog(String command) {
+    if (command.length() < 2 || command.length() > 3) return false;
+    char axis = command.charAt(0);
+    char direction = command.charAt(command.length() - 1);
+    if (command.length() == 3 && command.charAt(1) != ' ') return false;
+    return (axis == 'x' || axis == 'y' || axis == 'z') && (direction == '+' || direction == '-');
+}
+
+// Parses "<x> <y> <z>" in mm for the gripper tip
+void moveArmTo(String args) {
+    int first = args.indexOf(' ');
+    int second = args.indexOf(' ', first + 1);
+    if (first < 0 || second < 0) {
+        printMessage("Usage: goto <x> <y> <z>");
+        return;
+    }
+    ArmPoint target;
+    target.x = args.substring(0, first).toInt();
+    target.y = args.substring(first + 1, second).toInt();
+    target.z = args.substring(second + 1).toInt();
+    if (arm.moveTo(target)) {
+        printMessage("Moving gripper to: " + String(target.x) + ", " + String(target.y) + ", " + String(target.z) + " mm");
+    }
+}
+
+// Parses "<base height> <upper arm> <forearm>" in mm
+void setArmLinks(String args) {
+    int first = args.indexOf(' ');
+    int second = args.indexOf(' ', first + 1);
+    if (first < 0 || second < 0) {
+        printMessage("Usage: arm links <base height> <upper arm> <forearm>");
+        return;
+    }
+    int baseHeight = args.substring(0, first).toInt();
+    int upperArm = args.substring(first + 1, second).toInt();
+    int forearm = args.substring(second + 1).toInt();
+    arm.setLinkLengths(baseHeight, upperArm, forearm);
+    printMessage("Arm links set to: " + String(baseHeight) + "/" + String(upperArm) + "/" + String(forearm) + " mm");
+}
+
+// Parses "<speed> <radius>", radius in mm, positive to the left
+void driveArc(String args) {
+    int space = args.indexOf(' ');
+    if (space < 0) {
+        printMessage("Usage: arc <speed> <radius mm>");
+        return;
+    }
+    int speed = args.substring(0, space).toInt();
+    int radius = args.substring(space + 1).toInt();
+    motors.arc(speed, radius);
+    printMessage("Arc: speed " + String(speed) + ", radius " + String(radius) + " mm");
+}
+
+// Parses "<accel> <decel>" in PWM counts per second
+void setMotorRamp(String args) {
+    int space = args.indexOf(' ');
+    if (space < 0) {
+        printMessage("Usage: ramp <accel> <decel>");
+        return;
+    }
+    unsigned int accel = args.substring(0, space).toInt();
+    unsigned int decel = args.substring(space + 1).toInt();
+    motors.setRamp(accel, decel);
+    printMessage("Ramp set to: " + String(accel) + "/" + String(decel) + " per s");
+}
+
+// Parses "<stop> <turn> <critical>" in cm
+void setAvoidanceDistances(String args) {
+    int first = args.indexOf(' ');
+    int second = args.indexOf(' ', first + 1);
+    if (first < 0 || second < 0) {
+        printMessage("Usage: oa dist <stop> <turn> <critical>");
+        return;
     }
-    motors.stop();
-    printMessage("Navigation stopped");
+    int stopCm = args.substring(0, first).toInt();
+    int turnCm = args.substring(first + 1, second).toInt();
+    int criticalCm = args.substring(second + 1).toInt();
+    oa.setDistances(stopCm * 10, turnCm * 10, criticalCm * 10);
+    printMessage("Distances set to: " + String(stopCm) + "/" + String(turnCm) + "/" + String(criticalCm) + " cm");
 }
 
 void processMovementOrSave(String command, char action) {